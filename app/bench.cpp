@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <random>
+
+#include "bloom_filter.hpp"
+#include "parse_command.hpp"
+#include "read.hpp"
+#include "simd_kernels.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                               utils functions                              */
+/* -------------------------------------------------------------------------- */
+
+template <typename F>
+double time_it(F &&func)
+{
+    auto start = std::chrono::steady_clock::now();
+    func();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double>(stop - start).count();
+}
+
+void print_bench(const char *name, double seconds, size_t nb_items, uint64_t checksum)
+{
+    printf("%-34s %8.3f s  %8.2f ns/item  (checksum %lu)\n", name, seconds, seconds * 1e9 / static_cast<double>(nb_items),
+           checksum);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                Bloom lookup                                */
+/* -------------------------------------------------------------------------- */
+
+void bench_bloom_lookup(ssize_t nb_dpu, ssize_t size2, size_t nb_lookups, size_t nb_inserts)
+{
+    printf("Bloom lookup: %ld filters, 2^%ld rows, %zu lookups\n", nb_dpu, size2, nb_lookups);
+
+    std::mt19937_64 rng(42);
+    MultiBloomFilter bf{};
+    bf.initialize(nb_dpu, size2);
+    std::vector<hash_t> inserted;
+    inserted.reserve(static_cast<size_t>(nb_dpu) * nb_inserts);
+    for (ssize_t dpu_id = 0; dpu_id < nb_dpu; ++dpu_id)
+    {
+        for (size_t i = 0; i < nb_inserts; ++i)
+        {
+            auto h = static_cast<hash_t>(rng());
+            bf.insert(dpu_id, h);
+            inserted.push_back(h);
+        }
+    }
+
+    // Half of the lookups are random (mostly misses), the other half are pairs of inserted items
+    std::vector<std::pair<hash_t, hash_t>> signatures(nb_lookups);
+    for (size_t i = 0; i < nb_lookups; ++i)
+    {
+        if (i & 1)
+            signatures[i] = {inserted[rng() % inserted.size()], inserted[rng() % inserted.size()]};
+        else
+            signatures[i] = {static_cast<hash_t>(rng()), static_cast<hash_t>(rng())};
+    }
+
+    uint64_t checksum = 0;
+    auto t = time_it([&]()
+                     {
+        for (const auto &[h1, h2] : signatures)
+            for (auto dpu_id : bf.contains(h1, h2))
+                checksum += dpu_id; });
+    print_bench("LazyBfResult iterator", t, nb_lookups, checksum);
+
+    constexpr size_t BATCH_SIZE = 1024;
+    BfBatchResult result{};
+    checksum = 0;
+    t = time_it([&]()
+                {
+        for (size_t i = 0; i < nb_lookups; i += BATCH_SIZE)
+        {
+            auto n = std::min(BATCH_SIZE, nb_lookups - i);
+            bf.contains_batch({signatures.data() + i, n}, result);
+            for (auto dpu_id : result.dpu_ids)
+                checksum += dpu_id;
+        } });
+    print_bench("contains_batch", t, nb_lookups, checksum);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Encoding                                  */
+/* -------------------------------------------------------------------------- */
+
+// Previous encoding path: one pext per 4 bases and one push_back per byte, revcomp through a string copy
+__attribute__((target("bmi2"))) void legacy_append(std::vector<uint8_t> &out, const std::string &seq)
+{
+    for (size_t i = 0; i < seq.size(); i += 4)
+    {
+        const char *c = seq.data() + i;
+        alignas(4) char d[4] = {c[3], c[2], c[1], c[0]};
+        out.push_back(static_cast<uint8_t>(__builtin_ia32_pext_si(*reinterpret_cast<uint32_t *>(d), 0X06060606)));
+    }
+}
+
+void legacy_append_revcomp(std::vector<uint8_t> &out, const std::string &seq_const)
+{
+    std::string seq{seq_const};
+    std::reverse(seq.begin(), seq.end());
+    complement_read(seq);
+    legacy_append(out, seq);
+}
+
+uint64_t checksum_of(const std::vector<uint8_t> &data)
+{
+    uint64_t checksum = 0;
+    for (size_t i = 0; i < data.size(); ++i)
+        checksum += data[i] * (i + 1);
+    return checksum;
+}
+
+void bench_encoding(size_t nb_bases)
+{
+    nb_bases &= ~3UL; // Previous path reads past the end otherwise
+    printf("Encoding: %zu bases\n", nb_bases);
+
+    std::mt19937_64 rng(42);
+    std::string seq(nb_bases, 'A');
+    for (auto &c : seq)
+        c = "ACGT"[rng() & 3];
+
+    if (__builtin_cpu_supports("bmi2"))
+    {
+        std::vector<uint8_t> out;
+        auto t = time_it([&]()
+                         { legacy_append(out, seq); });
+        print_bench("pext + push_back", t, nb_bases, checksum_of(out));
+        out.clear();
+        t = time_it([&]()
+                    { legacy_append_revcomp(out, seq); });
+        print_bench("string revcomp + pext", t, nb_bases, checksum_of(out));
+    }
+
+    for (auto level : {SimdLevel::PORTABLE, SimdLevel::AVX2, SimdLevel::AVX512})
+    {
+        const auto &kernels = simd_kernels(level);
+        if (kernels.level != level)
+            continue; // Not supported by the host
+        std::vector<uint8_t> out((nb_bases + 3) / 4);
+        auto t = time_it([&]()
+                         { kernels.encode_bases(seq.data(), nb_bases, out.data()); });
+        print_bench((std::string("encode_bases ") + kernels.name).c_str(), t, nb_bases, checksum_of(out));
+        t = time_it([&]()
+                    { kernels.encode_bases(seq.data(), nb_bases, out.data());
+                      kernels.revcomp_codes(out.data(), nb_bases); });
+        print_bench((std::string("encode + revcomp_codes ") + kernels.name).c_str(), t, nb_bases, checksum_of(out));
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                    Main                                    */
+/* -------------------------------------------------------------------------- */
+
+int main(int argc, char *argv[])
+{
+    auto parsed = parse_bench(argc, argv);
+    printf("Using %s host kernels\n", simd_kernels().name);
+
+    bench_bloom_lookup(parsed["dpus"].as<ssize_t>(), parsed["bloom-size2"].as<ssize_t>(),
+                       parsed["lookups"].as<size_t>(), parsed["inserts"].as<size_t>());
+    bench_encoding(parsed["encode-size"].as<size_t>());
+
+    return 0;
+}
@@ -9,7 +9,26 @@ int main(int argc, char *argv[])
     auto reference_file = validate_file(parsed["reference"].as<std::string>());
     auto nb_ranks = parsed["ranks"].as<ssize_t>();
 
-    DpuMapper mapper(reference_file, nb_ranks, true);
+    DpuMapperOptions options{};
+    if (parsed["hierarchical-bloom"].as<bool>())
+        options.bloom_routing = BloomRouting::HIERARCHICAL;
+    options.hierarchical_fpr = parsed["hierarchical-fpr"].as<double>();
+    if (options.hierarchical_fpr <= 0.0 || options.hierarchical_fpr >= 1.0)
+        exit(printf("--hierarchical-fpr must be in ]0, 1[, got %f\n", options.hierarchical_fpr));
+    options.use_reference_cache = false; // Always reload the FASTA file, the cache is rebuilt here
+    options.write_reference_cache = true;
+    options.load_profile_path = parsed["load-profile"].as<std::string>();
+    if (!options.load_profile_path.empty())
+        validate_file(options.load_profile_path);
+    options.contig_packing = parsed["contig-packing"].as<bool>();
+    options.replica_ranks = parsed["replica-ranks"].as<size_t>();
+    options.spare_ranks = parsed["spare-ranks"].as<size_t>(); // Fewer slices, as in mapper runs with these spare ranks
+    options.nb_passes = parsed["passes"].as<size_t>();
+    options.minimizer_window = parsed["minimizer-window"].as<uint32_t>();
+    options.index_config = parse_index_config(parsed["index-config"].as<std::string>());
+    options.index_stats_path = parsed["index-stats"].as<std::string>();
+
+    DpuMapper mapper(reference_file, nb_ranks, true, options);
 
     return 0;
 }
\ No newline at end of file
@@ -10,7 +10,63 @@ int main(int argc, char *argv[])
     auto queries_file = validate_file(parsed["queries"].as<std::string>());
     auto nb_ranks = parsed["ranks"].as<ssize_t>();
 
-    DpuMapper mapper(reference_file, nb_ranks, true);
+    DpuMapperOptions options{};
+    if (parsed["hierarchical-bloom"].as<bool>())
+        options.bloom_routing = BloomRouting::HIERARCHICAL;
+    options.hierarchical_fpr = parsed["hierarchical-fpr"].as<double>();
+    if (options.hierarchical_fpr <= 0.0 || options.hierarchical_fpr >= 1.0)
+        exit(printf("--hierarchical-fpr must be in ]0, 1[, got %f\n", options.hierarchical_fpr));
+    options.speculative_dispatch = parsed["speculative-dispatch"].as<bool>();
+    options.max_fanout = parsed["max-fanout"].as<size_t>();
+    auto fanout_policy = parsed["fanout-policy"].as<std::string>();
+    if (fanout_policy == "least-loaded")
+        options.fanout_policy = FanoutPolicy::LEAST_LOADED;
+    else if (fanout_policy == "round-robin")
+        options.fanout_policy = FanoutPolicy::ROUND_ROBIN;
+    else if (fanout_policy == "repeat-path")
+        options.fanout_policy = FanoutPolicy::REPEAT_PATH;
+    else
+        exit(printf("Unknown fan-out policy %s\n", fanout_policy.c_str()));
+    options.load_profile_path = parsed["load-profile"].as<std::string>();
+    options.save_load_profile_path = parsed["save-load-profile"].as<std::string>();
+    if (!options.load_profile_path.empty())
+        validate_file(options.load_profile_path);
+    options.contig_packing = parsed["contig-packing"].as<bool>();
+    options.replica_ranks = parsed["replica-ranks"].as<size_t>();
+    options.nb_passes = parsed["passes"].as<size_t>();
+    options.minimizer_window = parsed["minimizer-window"].as<uint32_t>();
+    options.index_config = parse_index_config(parsed["index-config"].as<std::string>());
+    options.index_stats_path = parsed["index-stats"].as<std::string>();
+    options.spare_ranks = parsed["spare-ranks"].as<size_t>();
+    options.hot_slices_path = parsed["hot-slices"].as<std::string>();
+    if (!options.hot_slices_path.empty())
+        validate_file(options.hot_slices_path);
+    if (!options.hot_slices_path.empty() && options.spare_ranks == 0)
+        exit(printf("--hot-slices needs spare ranks, set with --spare-ranks\n"));
+    auto replica_policy = parsed["replica-policy"].as<std::string>();
+    if (replica_policy == "round-robin")
+        options.replica_policy = ReplicaPolicy::ROUND_ROBIN;
+    else if (replica_policy == "least-loaded")
+        options.replica_policy = ReplicaPolicy::LEAST_LOADED;
+    else
+        exit(printf("Unknown replica policy %s\n", replica_policy.c_str()));
+    options.launch.rank_fill = parsed["launch-fill"].as<double>();
+    options.launch.max_age_ms = parsed["launch-max-age"].as<double>();
+    options.launch.overflow = parsed["launch-overflow"].as<bool>();
+    if (options.launch.rank_fill <= 0.0 || options.launch.rank_fill > 1.0)
+        exit(printf("--launch-fill must be in ]0, 1], got %f\n", options.launch.rank_fill));
+    options.batch_ring = parsed["batch-ring"].as<size_t>();
+    if (options.batch_ring == 0 || options.batch_ring > MAX_BATCH_RING)
+        exit(printf("--batch-ring must be in [1, %u], got %zu\n", MAX_BATCH_RING, options.batch_ring));
+    options.launch.latency_mode = parsed["latency-mode"].as<bool>();
+    if (options.launch.latency_mode && options.launch.max_age_ms <= 0.0)
+        exit(printf("--latency-mode needs a deadline, set with --launch-max-age\n"));
+    if (options.launch.latency_mode && options.nb_passes > 1)
+        exit(printf("--latency-mode maps the reads as they arrive, it cannot be used with several passes\n"));
+
+    // Filters saved by the index app are loaded, a load profile needs a new partition and so new filters
+    bool rebuild_bloom = parsed["rebuild-bloom"].as<bool>() || !options.load_profile_path.empty();
+    DpuMapper mapper(reference_file, nb_ranks, rebuild_bloom, options);
 
     printf("Start mapping\n");
 
@@ -5,13 +5,29 @@
 /*                                Const values                                */
 /* -------------------------------------------------------------------------- */
 
-constexpr uint32_t DPU_SEED_SIZE = 13;
+// Seeds and count table of this build of the program, one of DPU_INDEX_CONFIGS
+#ifndef DPU_INDEX_SIZE2
+#define DPU_INDEX_SIZE2 22
+#endif
+#ifndef DPU_INDEX_SEED_SIZE
+#define DPU_INDEX_SEED_SIZE 13
+#endif
+
+constexpr uint32_t DPU_SEED_SIZE = DPU_INDEX_SEED_SIZE;
+static_assert(DPU_SEED_SIZE <= 13, "Queries only hold the bases of seeds up to 13 bases after the seed search ranges");
 
-constexpr uint32_t INDEX_SIZE2 = 22; // If > (DPU_SEED_SIZE * 2), there will be collisions in the table
+constexpr uint32_t INDEX_SIZE2 = DPU_INDEX_SIZE2; // If < (DPU_SEED_SIZE * 2), seeds are folded and collide in the table
 static_assert(INDEX_SIZE2 < 32, "Hash is on 32 bits");
+static_assert(INDEX_SIZE2 <= DPU_SEED_SIZE * 2, "Seeds must cover the whole table");
 
 constexpr uint32_t INDEX_SIZE = 1 << (INDEX_SIZE2);
-constexpr uint32_t INDEX_POS_SIZE = 1 << 23;
+
+// Positions are packed on POS_BITS bits in 64 bits words, instead of one 32 bits word each
+constexpr uint64_t POS_MASK = (1UL << POS_BITS) - 1;
+constexpr uint32_t POS_TABLE_WORDS = (DPU_INDEX_MRAM - INDEX_SIZE * sizeof(uint32_t)) / sizeof(uint64_t); // Rest of the index MRAM
+constexpr uint32_t INDEX_POS_SIZE = (POS_TABLE_WORDS * 64ULL) / POS_BITS;
+static_assert(INDEX_POS_SIZE == INDEX_POS_CAPACITY(INDEX_SIZE2), "The host sizes slices with the same capacity");
+static_assert(INDEX_POS_SIZE < (1 << 24), "Offsets of the positions must fit in 24 bits");
 
 constexpr uint8_t EXTRACT_RIGHT_MASK[4] = {0b1111'1111, 0b0011'1111, 0b0000'1111, 0b0000'0011};
 constexpr uint8_t EXTRACT_LEFT_MASK[5] = {0, 0b1100'0000, 0b1111'0000, 0b1111'1100, 0b1111'1111};
@@ -24,6 +40,14 @@ constexpr uint32_t SEED_SEARCH_RANGE = 30;
 constexpr uint32_t DELTA = 30;
 constexpr uint32_t GOOD_KEY_CNT = 30;
 
+constexpr uint32_t COLLISION_SAMPLE_STRIDE = 256; // Cells of the count table sampled for collisions
+
+// Minimizers are the seeds with the lowest order, a multiplication by an odd number mixes the keys without collisions
+constexpr uint32_t NO_KEY = UINT32_MAX;
+constexpr uint32_t MINIMIZER_HASH = 0x9E37'79B1;
+constexpr uint32_t MINIMIZER_HASH_INV = 0x0E8B'2F51;
+static_assert(MINIMIZER_HASH * MINIMIZER_HASH_INV == 1, "Keys are found back from their order");
+
 /* -------------------------------------------------------------------------- */
 /*                              Useful functions                              */
 /* -------------------------------------------------------------------------- */
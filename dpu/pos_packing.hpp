@@ -0,0 +1,60 @@
+#ifndef POS_PACKING_HPP
+#define POS_PACKING_HPP
+
+// Positions packed on POS_BITS bits in the 64 bits words of pos_table. Included once pos_table is declared: in MRAM by
+// the DPU program, as a plain array by the host tests.
+
+/// @brief Store the position of index x, the table is only written by one tasklet
+inline void write_pos(uint32_t x, uint32_t pos)
+{
+	uint32_t bit = x * POS_BITS;
+	uint32_t word = bit >> 6;
+	uint32_t shift = bit & 63;
+	pos_table[word] = (pos_table[word] & ~(POS_MASK << shift)) | (static_cast<uint64_t>(pos) << shift);
+	if (shift + POS_BITS > 64)
+	{
+		pos_table[word + 1] = (pos_table[word + 1] & ~(POS_MASK >> (64 - shift))) | (static_cast<uint64_t>(pos) >> (64 - shift));
+	}
+}
+
+/// @brief Reads the positions of a key one after the other, with one MRAM access per 64 bits word
+struct PosCursor
+{
+	uint32_t bit;
+	uint32_t word;
+	uint64_t low;  // Word holding the first bit of the current position
+	uint64_t high; // Next word
+
+	inline void init(uint32_t x)
+	{
+		bit = x * POS_BITS;
+		word = bit >> 6;
+		low = pos_table[word];
+		high = pos_table[word + 1];
+	}
+
+	inline uint32_t value() const
+	{
+		uint32_t shift = bit & 63;
+		uint64_t val = low >> shift;
+		if (shift + POS_BITS > 64)
+		{
+			val |= high << (64 - shift);
+		}
+		return static_cast<uint32_t>(val & POS_MASK);
+	}
+
+	inline uint32_t next()
+	{
+		bit += POS_BITS;
+		if ((bit >> 6) != word)
+		{
+			++word;
+			low = high;
+			high = pos_table[word + 1];
+		}
+		return value();
+	}
+};
+
+#endif // POS_PACKING_HPP
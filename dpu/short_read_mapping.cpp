@@ -11,14 +11,17 @@ extern "C"
 #include <stdint.h>
 }
 
-#include "dpu_utils.hpp"
 #include "../src/pim_common.hpp"
+#include "dpu_utils.hpp"
 
 constexpr uint8_t NR_TASKLETS_MASK = (NR_TASKLETS - 1);
 
 /* ---------------------------------- WRAM ---------------------------------- */
 
-constexpr uint32_t SEQUENCE_MAX_SIZE = 1 << 22; // One DPU can hold a reference of up to ~16 M base pairs
+constexpr uint32_t SEQUENCE_MAX_SIZE = 6 << 20; // One DPU can hold a reference of up to ~24 M base pairs
+static_assert(SEQUENCE_MAX_SIZE * 4 <= (1 << POS_BITS), "Positions must fit in POS_BITS");
+static_assert(MAX_MINIMIZER_WINDOW <= DELTA && MAX_MINIMIZER_WINDOW <= SEED_SEARCH_RANGE + 1,
+			  "The windows of the query minimizers must fit in the seed search ranges");
 
 constexpr uint32_t CACHE32_SIZE = 512;
 constexpr uint32_t CACHE64_SIZE = CACHE32_SIZE >> 1;
@@ -28,9 +31,13 @@ constexpr uint32_t CACHE_SEED_SIZE =
 	CEILN<8>(DPU_SEED_SIZE) + 8; // Start position will be aligned so reserve a bit more space
 constexpr uint32_t CACHE_SEED_RESULT_SIZE = CEILN<8>(MAX_NB_QUERIES_PER_DPU / NR_TASKLETS) + 8;
 
-__host IndexArgs index_args; // 8 B
+__host IndexArgs index_args; // 16 B
 bool index_built = false;
 
+// Statistics read by the host
+__host IndexStats index_stats{};
+__host uint64_t nb_verifications = 0; // Candidate positions compared to queries, since the index was built
+
 __dma_aligned uint32_t gcache32_cum_table[CACHE32_SIZE];
 
 __dma_aligned bool GOOD_SEEDS[256] = { // Hardcoded array to indicate good seeds from 4 bases
@@ -53,16 +60,18 @@ __dma_aligned bool GOOD_SEEDS[256] = { // Hardcoded array to indicate good seeds
 
 /* ---------------------------------- MRAM ---------------------------------- */
 
-__mram_noinit uint8_t sequence[SEQUENCE_MAX_SIZE]; //     4 MB
-__mram_noinit MapArgs map_args = MapArgs();		   // < 100 KB
-__mram MapResults map_results{};				   // <  10 KB
+__mram_noinit uint8_t sequence[SEQUENCE_MAX_SIZE]; //     6 MB
+__mram_noinit MapArgs map_args[MAX_BATCH_RING];	   // < 300 KB
+__mram_noinit SharedQueries shared_queries[MAX_BATCH_RING]; //   1 MB
+__mram MapResults map_results[MAX_BATCH_RING]{};   // <  70 KB
+__mram MapMailbox mailbox{1, 0};				   // Batches of the ring to map in this launch
 
 // Index variables
-__mram uint32_t cnt_table[INDEX_SIZE]; // 16 MB (initialized with 0s)
+__mram uint32_t cnt_table[INDEX_SIZE]; // 4 to 32 MB (initialized with 0s)
 // Packed 32 bits values: cum cnt (24) on lower, cnt on upper (8)
 
-__mram_noinit uint32_t pos_table[INDEX_POS_SIZE]; // 32 MB
-// 32 bits per pos is enough, has maximum 16 M bases in sequence
+__mram_noinit uint64_t pos_table[POS_TABLE_WORDS + 2]; // Rest of DPU_INDEX_MRAM
+// Packed POS_BITS values, the last words are only read by the cursors past the end
 
 // Test / debug variable
 __mram uint64_t checksum = 0;
@@ -70,15 +79,14 @@ __mram uint64_t checksum = 0;
 /* ----------------------------- Synchronization ---------------------------- */
 
 MUTEX_POOL_INIT(mutex_pool16, 16);
-#ifdef DO_DPU_PERFCOUNTER
 BARRIER_INIT(barrier_all, NR_TASKLETS);
-#endif
 
 /* -------------------------------------------------------------------------- */
 /*                               Index reference                              */
 /* -------------------------------------------------------------------------- */
 
-inline uint32_t get_seq_key(uint32_t start, uint32_t offset, uint8_t *seq)
+/// @brief Bases of the seed starting at offset in byte start, 2 bits each
+inline uint32_t get_seq_kmer(uint32_t start, uint32_t offset, uint8_t *seq)
 {
 	// Encode as a key
 	start += 4;
@@ -93,10 +101,18 @@ inline uint32_t get_seq_key(uint32_t start, uint32_t offset, uint8_t *seq)
 	{
 		key = key >> SHIFT_LENGTH[4 - remaining_bases];
 	}
+	return key;
+}
+
+inline uint32_t get_seq_key(uint32_t start, uint32_t offset, uint8_t *seq)
+{
+	auto key = get_seq_kmer(start, offset, seq);
 	// The index may not be big enough, so hash to fit into the table (will cause some collisions)
 	return (key ^ (key >> INDEX_SIZE2)) & (INDEX_SIZE - 1);
 }
 
+#include "pos_packing.hpp" // Reads and writes pos_table
+
 void compute_cum_table()
 {
 	// Fill cumulative table using a cache in WRAM
@@ -104,6 +120,11 @@ void compute_cum_table()
 	mram_read(cnt_table, gcache32_cum_table, transfer_size);
 	auto cum_value = gcache32_cum_table[0];
 	gcache32_cum_table[0] = 0;
+	if (cum_value != 0)
+	{
+		index_stats.nb_cells++;
+		index_stats.sum_squared_cnt += cum_value * cum_value;
+	}
 	uint32_t cache_idx = 1, start_idx = 0;
 	for (uint32_t i = 1; i < INDEX_SIZE; ++i)
 	{
@@ -117,27 +138,87 @@ void compute_cum_table()
 		auto x = gcache32_cum_table[cache_idx];
 		gcache32_cum_table[cache_idx] = cum_value;
 		cum_value += x;
+		if (x != 0)
+		{
+			index_stats.nb_cells++;
+			index_stats.sum_squared_cnt += x * x;
+		}
 		cache_idx++;
 	}
 	mram_write(gcache32_cum_table, &cnt_table[start_idx], transfer_size);
 }
 
-void index(uint8_t *cache8)
+/// @brief Order of a key among the seeds of a minimizer window
+inline uint32_t minimizer_order(uint32_t key) { return key == NO_KEY ? NO_KEY : (key * MINIMIZER_HASH) & (INDEX_SIZE - 1); }
+
+/// @brief Key of a minimizer from its order
+inline uint32_t minimizer_key(uint32_t order) { return (order * MINIMIZER_HASH_INV) & (INDEX_SIZE - 1); }
+
+/// @brief Sliding window over the orders of the last seeds, keeps its minimum and how many seeds ago it was pushed.
+/// Ties go to the oldest seed, so that the minimizer only depends on the bases of the window.
+struct MinimizerWindow
 {
-	auto size = index_args.seq_size - DPU_SEED_SIZE + 1 -
-				4; // Keys ignore first 4 bases
-				   // Since we filter seeds, maybe that affect the distribution into the hash space
+	uint32_t orders[MAX_MINIMIZER_WINDOW];
+	uint32_t width;
+	uint32_t head; // Slot of the next seed, which is the oldest one when the window is complete
+	uint32_t nb_seeds;
+	uint32_t min_order;
+	uint32_t min_age;
+
+	inline void init(uint32_t w)
+	{
+		width = w;
+		head = 0;
+		nb_seeds = 0;
+		min_order = NO_KEY;
+		min_age = 0;
+	}
 
-	// Count kmers
-	// Split work between tasklets
-	uint32_t cache_idx = CACHE8_SIZE_REDUCED + me(), start_idx = 0;
-	for (uint32_t i = me() << 2; i < size; i += (NR_TASKLETS << 2), cache_idx += NR_TASKLETS)
+	inline bool complete() const { return nb_seeds >= width; }
+
+	inline void push(uint32_t order)
+	{
+		orders[head] = order;
+		head = (head + 1 == width) ? 0 : head + 1;
+		nb_seeds++;
+		min_age++;
+		if (order < min_order)
+		{
+			min_order = order;
+			min_age = 0;
+		}
+		else if (min_age >= width)
+		{
+			// The minimum left the window, scan it from the oldest seed
+			min_order = NO_KEY;
+			uint32_t slot = head;
+			for (uint32_t age = width; age > 0; --age)
+			{
+				if (orders[slot] < min_order)
+				{
+					min_order = orders[slot];
+					min_age = age - 1;
+				}
+				slot = (slot + 1 == width) ? 0 : slot + 1;
+			}
+		}
+	}
+};
+
+/// @brief Calls func(pos, key) for every position of [begin, end) of the sequence, key is NO_KEY if the seed is not good
+template <typename F>
+inline void for_each_seed(uint32_t begin, uint32_t end, uint8_t *cache8, F &&func)
+{
+	uint32_t start_idx = FLOORN<8>(begin >> 2);
+	uint32_t cache_idx = (begin >> 2) - start_idx;
+	mram_read(&sequence[start_idx], cache8, CACHE8_SIZE * sizeof(uint8_t));
+	for (uint32_t i = FLOORN<4>(begin); i < end; i += 4, ++cache_idx)
 	{
 		if (cache_idx >= CACHE8_SIZE_REDUCED)
 		{
-			mram_read(&sequence[start_idx], cache8, CACHE8_SIZE * sizeof(uint8_t));
 			start_idx += CACHE8_SIZE_REDUCED;
 			cache_idx -= CACHE8_SIZE_REDUCED;
+			mram_read(&sequence[start_idx], cache8, CACHE8_SIZE * sizeof(uint8_t));
 		}
 		uint8_t seeds[4];
 		seeds[0] = cache8[cache_idx];
@@ -146,34 +227,121 @@ void index(uint8_t *cache8)
 		seeds[3] = (cache8[cache_idx] << 6) | (cache8[cache_idx + 1] >> 2);
 		for (uint32_t j = 0; j < 4; ++j)
 		{
-			if (i + j >= size)
+			if (i + j >= end)
 			{
 				break;
 			}
-			if (GOOD_SEEDS[seeds[j]])
+			if (i + j >= begin)
 			{
-				auto key = get_seq_key(cache_idx, j, cache8);
-				// NB : Two cells in same 8 bytes need to get the same mutex to
-				// avoid data races (Implicit write access of MRAM variables is
-				// not multi-tasklet safe for data types lower than 8 bytes)
-				auto mutex_id = (key >> 1) & NR_TASKLETS_MASK;
-				mutex_pool_lock(&mutex_pool16, mutex_id);
-				if (cnt_table[key] < MAX_KEY_CNT)
-				{
-					cnt_table[key]++;
-				}
-				mutex_pool_unlock(&mutex_pool16, mutex_id);
+				func(i + j, GOOD_SEEDS[seeds[j]] ? get_seq_key(cache_idx, j, cache8) : NO_KEY);
+			}
+		}
+	}
+}
+
+/// @brief Calls func(pos, key) for every seed of [begin, end) held by the index: all the good seeds, or the minimizers
+/// of the windows of index_args.minimizer_window seeds. The windows of a minimizer may start before begin or end after
+/// end, up to size.
+template <typename F>
+inline void for_each_indexed_seed(uint32_t begin, uint32_t end, uint32_t size, uint8_t *cache8, F &&func)
+{
+	auto w = index_args.minimizer_window;
+	if (w <= 1)
+	{
+		for_each_seed(begin, end, cache8, [&func](uint32_t pos, uint32_t key)
+					  {
+			if (key != NO_KEY)
+			{
+				func(pos, key);
+			} });
+		return;
+	}
+
+	MinimizerWindow window;
+	window.init(w);
+	uint32_t last = NO_KEY;
+	for_each_seed(begin >= w - 1 ? begin - w + 1 : 0, MIN(size, end + w - 1), cache8,
+				  [&](uint32_t pos, uint32_t key)
+				  {
+		window.push(minimizer_order(key));
+		if (!window.complete() || window.min_order == NO_KEY)
+		{
+			return;
+		}
+		// Minimizers of consecutive windows never go back
+		auto min_pos = pos - window.min_age;
+		if (min_pos >= begin && min_pos < end && min_pos != last)
+		{
+			last = min_pos;
+			func(min_pos, minimizer_key(window.min_order));
+		} });
+}
+
+/// @brief Bases of the seed at pos of the sequence
+inline uint32_t read_seq_kmer(uint32_t pos, uint8_t *cache8)
+{
+	mram_read(&sequence[FLOORN<8>(pos >> 2)], cache8, 16 * sizeof(uint8_t));
+	return get_seq_kmer(REMAINDERN<8>(pos >> 2), pos & 3, cache8);
+}
+
+/// @brief Count the positions of one cell in COLLISION_SAMPLE_STRIDE whose seed is not the one of the first position
+/// of the cell: folded seeds share cells, and these positions are spurious candidates for the seeds of the cell
+void sample_collisions(uint8_t *cache8)
+{
+	for (uint32_t key = 0; key < INDEX_SIZE; key += COLLISION_SAMPLE_STRIDE)
+	{
+		auto val = cnt_table[key];
+		auto cnt = UNPACK_UPPER8(val);
+		index_stats.nb_sampled += cnt;
+		if (cnt < 2)
+		{
+			continue;
+		}
+		PosCursor cursor;
+		cursor.init(UNPACK_LOWER24(val) - cnt);
+		auto first = read_seq_kmer(cursor.value(), cache8);
+		for (uint32_t n = 1; n < cnt; ++n)
+		{
+			if (read_seq_kmer(cursor.next(), cache8) != first)
+			{
+				index_stats.nb_collisions++;
 			}
 		}
 	}
+}
 
-	// Sequential after that, exit all tasklets except 0
+void index(uint8_t *cache8)
+{
+	uint32_t size = index_args.seq_size - DPU_SEED_SIZE + 1 -
+					4; // Keys ignore first 4 bases
+					   // Since we filter seeds, maybe that affect the distribution into the hash space
+
+	// Count kmers
+	// Split work between tasklets, in contiguous parts so that the windows of the minimizers slide over them
+	uint32_t part_size = CEILN<4>(size / NR_TASKLETS + 1);
+	uint32_t begin = MIN(size, me() * part_size);
+	for_each_indexed_seed(begin, MIN(size, begin + part_size), size, cache8, [](uint32_t, uint32_t key)
+						  {
+		// NB : Two cells in same 8 bytes need to get the same mutex to
+		// avoid data races (Implicit write access of MRAM variables is
+		// not multi-tasklet safe for data types lower than 8 bytes)
+		auto mutex_id = (key >> 1) & NR_TASKLETS_MASK;
+		mutex_pool_lock(&mutex_pool16, mutex_id);
+		if (cnt_table[key] < MAX_KEY_CNT)
+		{
+			cnt_table[key]++;
+		}
+		mutex_pool_unlock(&mutex_pool16, mutex_id); });
+
+	// Sequential after that, exit all tasklets except 0 once every part is counted
+	barrier_wait(&barrier_all);
 	if (me() != 0)
 	{
 		return;
 	}
 
 	// Compute cumulative cnt
+	index_stats = IndexStats{};
 	compute_cum_table();
 
 	// Set checksum for debug
@@ -181,46 +349,28 @@ void index(uint8_t *cache8)
 	// checksum = nb_positions;
 
 	// Register positions
-	cache_idx = CACHE8_SIZE_REDUCED + me(), start_idx = 0;
-	for (uint32_t i = 0; i < size; i += 4, ++cache_idx)
-	{
-		if (cache_idx >= CACHE8_SIZE_REDUCED)
+	for_each_indexed_seed(0, size, size, cache8, [](uint32_t pos, uint32_t key)
+						  {
+		auto val = cnt_table[key];
+		auto cnt = UNPACK_UPPER8(val);
+		if (cnt < MAX_KEY_CNT)
 		{
-			mram_read(&sequence[start_idx], cache8, CACHE8_SIZE * sizeof(uint8_t));
-			start_idx += CACHE8_SIZE_REDUCED;
-			cache_idx -= CACHE8_SIZE_REDUCED;
-		}
-		uint8_t seeds[4];
-		seeds[0] = cache8[cache_idx];
-		seeds[1] = (cache8[cache_idx] << 2) | (cache8[cache_idx + 1] >> 6);
-		seeds[2] = (cache8[cache_idx] << 4) | (cache8[cache_idx + 1] >> 4);
-		seeds[3] = (cache8[cache_idx] << 6) | (cache8[cache_idx + 1] >> 2);
-		for (uint32_t j = 0; j < 4; ++j)
-		{
-			if (i + j >= size)
-			{
-				break;
-			}
-			if (GOOD_SEEDS[seeds[j]])
+			auto x = UNPACK_LOWER24(val);
+			assert(x < INDEX_POS_SIZE); // The host picks a program whose table holds all the good seeds of the
+										// slice, but check just in case
+			if (x >= INDEX_POS_SIZE)
 			{
-				auto key = get_seq_key(cache_idx, j, cache8);
-				auto val = cnt_table[key];
-				auto cnt = UNPACK_UPPER8(val);
-				if (cnt < MAX_KEY_CNT)
-				{
-					auto x = UNPACK_LOWER24(val);
-					assert(x < INDEX_POS_SIZE); // Only 8M space for potential 16M pos if ref max size and all
-												// seeds are good. Unlikely, but check just in case
-					if (x >= INDEX_POS_SIZE)
-					{
-						__asm__("fault 1");
-					}
-					pos_table[x] = i + j;
-					// NB: the cum cnt table is modified, it won't start at 0 anymore
-					cnt_table[key] = val + 1 + P2_24;
-				}
+				__asm__("fault 1");
 			}
-		}
+			write_pos(x, pos);
+			// NB: the cum cnt table is modified, it won't start at 0 anymore
+			cnt_table[key] = val + 1 + P2_24;
+			index_stats.nb_positions++;
+		} });
+
+	if constexpr (INDEX_SIZE2 < DPU_SEED_SIZE * 2)
+	{
+		sample_collisions(cache8);
 	}
 }
 
@@ -286,9 +436,59 @@ inline void hammning_distance_positions(uint32_t x1, uint32_t x2, uint32_t &num_
 		:);
 }
 
-void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cache_sizes, uint64_t *cache_result)
+/// @brief Among the minimizers of the windows of the query starting at [first, first + nb_windows), find the one with
+/// the lowest non-zero count in the index
+/// @return offset of the minimizer from first, or NO_KEY if none is in the index (then cnt is 0)
+inline uint32_t find_minimizer(uint8_t *query, uint32_t first, uint32_t nb_windows, uint32_t &key, uint32_t &cnt)
 {
-	auto nb_queries = map_args.nb_queries;
+	MinimizerWindow window;
+	window.init(index_args.minimizer_window);
+	uint32_t best = NO_KEY, last = NO_KEY;
+	cnt = UINT32_MAX;
+
+	uint8_t bases[4];
+	bases[0] = get_seq_base(0, first, query);
+	bases[1] = get_seq_base(0, first + 1, query);
+	bases[2] = get_seq_base(0, first + 2, query);
+	for (uint32_t t = 0, pos = first; t < nb_windows + window.width - 1; ++t, ++pos)
+	{
+		bases[3] = get_seq_base(0, pos + 3, query);
+		window.push(is_good_seed(bases) ? minimizer_order(get_seq_key(pos >> 2, pos & 3, query)) : NO_KEY);
+		bases[0] = bases[1];
+		bases[1] = bases[2];
+		bases[2] = bases[3];
+		if (!window.complete() || window.min_order == NO_KEY || t - window.min_age == last)
+		{
+			continue;
+		}
+
+		// Count of a minimizer is only read once, when the windows reach it
+		last = t - window.min_age;
+		auto k = minimizer_key(window.min_order);
+		auto c = UNPACK_UPPER8(cnt_table[k]);
+		if (c != 0 && c < cnt)
+		{
+			key = k;
+			cnt = c;
+			best = last;
+			if (c <= GOOD_KEY_CNT)
+			{
+				break;
+			}
+		}
+	}
+	if (best == NO_KEY)
+	{
+		key = 0;
+		cnt = 0;
+	}
+	return best;
+}
+
+void map(uint32_t batch, uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cache_sizes,
+		 uint16_t *cache_slots, uint64_t *cache_result)
+{
+	auto nb_queries = map_args[batch].nb_queries;
 
 	uint32_t D = nb_queries / NR_TASKLETS;
 	uint32_t K = REMAINDERN<NR_TASKLETS>(nb_queries);
@@ -297,11 +497,13 @@ void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cac
 	uint32_t stop_index = start_index + D + (me() < K ? 1 : 0);
 	uint32_t my_nb_queries = stop_index - start_index;
 
-	mram_read(&map_args.seed_positions[FLOORN<8>(start_index)], cache_seed, CACHE_SEED_RESULT_SIZE * sizeof(uint32_t));
-	mram_read(&map_args.query_sizes[FLOORN<8>(start_index)], cache_sizes, CACHE_SEED_RESULT_SIZE * sizeof(uint8_t));
+	mram_read(&map_args[batch].seed_positions[FLOORN<8>(start_index)], cache_seed, CACHE_SEED_RESULT_SIZE * sizeof(uint32_t));
+	mram_read(&map_args[batch].query_sizes[FLOORN<8>(start_index)], cache_sizes, CACHE_SEED_RESULT_SIZE * sizeof(uint8_t));
+	mram_read(&map_args[batch].query_slots[FLOORN<8>(start_index)], cache_slots, CACHE_SEED_RESULT_SIZE * sizeof(uint16_t));
 
 	uint64_t results_data[CACHE_SEED_RESULT_SIZE];
 	uint64_t results_error_positions[CACHE_SEED_RESULT_SIZE];
+	uint32_t my_nb_verifications = 0;
 
 	// Each tasklet has its own read
 	for (uint32_t query_idx = start_index; query_idx < stop_index; ++query_idx)
@@ -320,25 +522,83 @@ void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cac
 
 		/* ----------------------- Retrieve full query in WRAM ---------------------- */
 
-		auto start_pos = query_idx * (MAX_QUERY_SIZE / 4);
-		mram_read(&map_args.queries[start_pos], cache8, ((MAX_QUERY_SIZE / 4) + 8) * sizeof(uint8_t));
-
-		/* ------------------------------ Compute key1 ------------------------------ */
-
-		uint32_t offset2 = seed_pos & 3;
-		uint32_t cache_idx = seed_pos >> 2;
+		// Queries sent to several DPUs of the rank are in the broadcast region
+		uint32_t slot = cache_slots[query_idx - start_index + REMAINDERN<8>(start_index)];
+		if (slot < MAX_NB_QUERIES_PER_DPU)
+		{
+			mram_read(&map_args[batch].queries[slot * (MAX_QUERY_SIZE / 4)], cache8, ((MAX_QUERY_SIZE / 4) + 8) * sizeof(uint8_t));
+		}
+		else
+		{
+			mram_read(&shared_queries[batch].queries[(slot - MAX_NB_QUERIES_PER_DPU) * (MAX_QUERY_SIZE / 4)], cache8,
+					  ((MAX_QUERY_SIZE / 4) + 8) * sizeof(uint8_t));
+		}
 
-		auto key1 = get_seq_key(cache_idx, offset2, cache8);
-		auto cnt1 = UNPACK_UPPER8(cnt_table[key1]);
+		/* ------------------------------ Compute keys ------------------------------ */
 
+		uint32_t key1, cnt1, key2, cnt2;
 		uint32_t skip_offset = 0;
+		uint32_t skip_offset2 = SEED_SEARCH_RANGE + 1;
 
-		// Start at pos given by host and try to find a seed with a low count to reduce the number of loop turns later
-		if (cnt1 == 0 || cnt1 > GOOD_KEY_CNT)
+		if (index_args.minimizer_window > 1)
+		{
+			// An error free part of the query shares the minimizers of its windows with the reference: key1 is the
+			// minimizer of a window before DELTA, key2 of a window after, so they are two different seeds
+			auto w = index_args.minimizer_window;
+			skip_offset = find_minimizer(cache8, seed_pos, DELTA - w + 1, key1, cnt1);
+			skip_offset2 = find_minimizer(cache8, seed_pos + DELTA, SEED_SEARCH_RANGE - w + 2, key2, cnt2);
+		}
+		else
 		{
+			/* ---------------------------- Compute key1 ---------------------------- */
+
+			uint32_t offset2 = seed_pos & 3;
+			uint32_t cache_idx = seed_pos >> 2;
+
+			key1 = get_seq_key(cache_idx, offset2, cache8);
+			cnt1 = UNPACK_UPPER8(cnt_table[key1]);
+
+			// Start at pos given by host and try to find a seed with a low count to reduce the number of loop turns
+			// later
+			if (cnt1 == 0 || cnt1 > GOOD_KEY_CNT)
+			{
+				bases[0] = get_seq_base(cache_idx, offset2, cache8);
+				bases[1] = get_seq_base(cache_idx, offset2 + 1, cache8);
+				bases[2] = get_seq_base(cache_idx, offset2 + 2, cache8);
+				for (uint32_t test_offset = 0; test_offset <= SEED_SEARCH_RANGE; ++test_offset, ++offset2)
+				{
+					bases[3] = get_seq_base(cache_idx, offset2 + 3, cache8);
+					if (is_good_seed(bases))
+					{
+						auto key = get_seq_key(cache_idx + (offset2 >> 2), offset2 & 3, cache8);
+						auto cnt = UNPACK_UPPER8(cnt_table[key]);
+						if (cnt < cnt1 || cnt1 == 0)
+						{
+							key1 = key;
+							cnt1 = cnt;
+							skip_offset = test_offset;
+							if (cnt <= GOOD_KEY_CNT)
+							{
+								break;
+							}
+						}
+					}
+					bases[0] = bases[1];
+					bases[1] = bases[2];
+					bases[2] = bases[3];
+				}
+			}
+
+			/* ---------------------------- Compute key2 ---------------------------- */
+
+			offset2 = (seed_pos + DELTA) & 3;
+			cache_idx = (seed_pos + DELTA) >> 2;
+
+			// Find another good seed further, again with low count if possible
 			bases[0] = get_seq_base(cache_idx, offset2, cache8);
 			bases[1] = get_seq_base(cache_idx, offset2 + 1, cache8);
 			bases[2] = get_seq_base(cache_idx, offset2 + 2, cache8);
+			cnt2 = UINT32_MAX;
 			for (uint32_t test_offset = 0; test_offset <= SEED_SEARCH_RANGE; ++test_offset, ++offset2)
 			{
 				bases[3] = get_seq_base(cache_idx, offset2 + 3, cache8);
@@ -346,11 +606,11 @@ void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cac
 				{
 					auto key = get_seq_key(cache_idx + (offset2 >> 2), offset2 & 3, cache8);
 					auto cnt = UNPACK_UPPER8(cnt_table[key]);
-					if (cnt < cnt1 || cnt1 == 0)
+					if (cnt != 0 && cnt < cnt2)
 					{
-						key1 = key;
-						cnt1 = cnt;
-						skip_offset = test_offset;
+						key2 = key;
+						cnt2 = cnt;
+						skip_offset2 = test_offset;
 						if (cnt <= GOOD_KEY_CNT)
 						{
 							break;
@@ -362,53 +622,20 @@ void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cac
 				bases[2] = bases[3];
 			}
 		}
-
-		auto idx1 = UNPACK_LOWER24(cnt_table[key1]) - cnt1;
-		auto pos1 = pos_table[idx1];
-
-		/* ------------------------------ Compute key2 ------------------------------ */
-
-		offset2 = (seed_pos + DELTA) & 3;
-		cache_idx = (seed_pos + DELTA) >> 2;
-
-		// Find another good seed further, again with low count if possible
-		bases[0] = get_seq_base(cache_idx, offset2, cache8);
-		bases[1] = get_seq_base(cache_idx, offset2 + 1, cache8);
-		bases[2] = get_seq_base(cache_idx, offset2 + 2, cache8);
-		uint32_t skip_offset2 = SEED_SEARCH_RANGE + 1;
-		uint32_t key2;
-		uint64_t cnt2 = UINT64_MAX;
-		for (uint32_t test_offset = 0; test_offset <= SEED_SEARCH_RANGE; ++test_offset, ++offset2)
-		{
-			bases[3] = get_seq_base(cache_idx, offset2 + 3, cache8);
-			if (is_good_seed(bases))
-			{
-				auto key = get_seq_key(cache_idx + (offset2 >> 2), offset2 & 3, cache8);
-				auto cnt = UNPACK_UPPER8(cnt_table[key]);
-				if (cnt != 0 && cnt < cnt2)
-				{
-					key2 = key;
-					cnt2 = cnt;
-					skip_offset2 = test_offset;
-					if (cnt <= GOOD_KEY_CNT)
-					{
-						break;
-					}
-				}
-			}
-			bases[0] = bases[1];
-			bases[1] = bases[2];
-			bases[2] = bases[3];
-		}
-		if (skip_offset2 > SEED_SEARCH_RANGE)
+		if (cnt1 == 0 || skip_offset2 > SEED_SEARCH_RANGE)
 		{
 			results_data[query_idx - start_index] = ENCODE_MAP_RESULT(result_distance, result_pos);
 			results_error_positions[query_idx - start_index] = error_positions;
 			continue;
 		}
 
-		auto idx2 = UNPACK_LOWER24(cnt_table[key2]) - cnt2;
-		auto pos2 = pos_table[idx2];
+		PosCursor cursor1;
+		cursor1.init(UNPACK_LOWER24(cnt_table[key1]) - cnt1);
+		auto pos1 = cursor1.value();
+
+		PosCursor cursor2;
+		cursor2.init(UNPACK_LOWER24(cnt_table[key2]) - cnt2);
+		auto pos2 = cursor2.value();
 
 		/* --------------------------- Prepare comparison --------------------------- */
 
@@ -434,8 +661,9 @@ void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cac
 				auto pos = pos1;
 				if (pos >= seed_pos)
 				{
+					my_nb_verifications++;
 					// Retrieve sequence part in WRAM
-					start_pos = pos - seed_pos;
+					auto start_pos = pos - seed_pos;
 					mram_read(&sequence[FLOORN<8>(start_pos >> 2)], cache8bis,
 							  (CEILN<8>(data_size) + 8) * sizeof(uint8_t));
 					uint8_t *ref_seq = cache8bis + REMAINDERN<8>(start_pos >> 2);
@@ -505,19 +733,19 @@ void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cac
 				}
 
 				n1++;
-				pos1 = pos_table[idx1 + n1];
+				pos1 = cursor1.next();
 				n2++;
-				pos2 = pos_table[idx2 + n2];
+				pos2 = cursor2.next();
 			}
 			else if (pos1 + dist_keys < pos2)
 			{
 				n1++;
-				pos1 = pos_table[idx1 + n1];
+				pos1 = cursor1.next();
 			}
 			else
 			{
 				n2++;
-				pos2 = pos_table[idx2 + n2];
+				pos2 = cursor2.next();
 			}
 		}
 
@@ -528,20 +756,21 @@ void map(uint8_t *cache8, uint8_t *cache8bis, uint32_t *cache_seed, uint8_t *cac
 
 	// Commit results in MRAM
 	mutex_pool_lock(&mutex_pool16, 0);
-	mram_read(&map_results.data[FLOORN<8>(start_index)], cache_result, CACHE_SEED_RESULT_SIZE * sizeof(uint64_t));
+	mram_read(&map_results[batch].data[FLOORN<8>(start_index)], cache_result, CACHE_SEED_RESULT_SIZE * sizeof(uint64_t));
 	for (uint32_t i = 0; i < my_nb_queries; ++i)
 	{
 		cache_result[i + REMAINDERN<8>(start_index)] = results_data[i];
 	}
-	mram_write(cache_result, &map_results.data[FLOORN<8>(start_index)], CACHE_SEED_RESULT_SIZE * sizeof(uint64_t));
-	mram_read(&map_results.error_positions[FLOORN<8>(start_index)], cache_result,
+	mram_write(cache_result, &map_results[batch].data[FLOORN<8>(start_index)], CACHE_SEED_RESULT_SIZE * sizeof(uint64_t));
+	mram_read(&map_results[batch].error_positions[FLOORN<8>(start_index)], cache_result,
 			  CACHE_SEED_RESULT_SIZE * sizeof(uint64_t));
 	for (uint32_t i = 0; i < my_nb_queries; ++i)
 	{
 		cache_result[i + REMAINDERN<8>(start_index)] = results_error_positions[i];
 	}
-	mram_write(cache_result, &map_results.error_positions[FLOORN<8>(start_index)],
+	mram_write(cache_result, &map_results[batch].error_positions[FLOORN<8>(start_index)],
 			   CACHE_SEED_RESULT_SIZE * sizeof(uint64_t));
+	nb_verifications += my_nb_verifications;
 	mutex_pool_unlock(&mutex_pool16, 0);
 }
 
@@ -557,6 +786,7 @@ int main()
 	__dma_aligned uint64_t cache_result[CACHE_SEED_RESULT_SIZE];
 
 	uint8_t *cache_sizes = (uint8_t *)cache_result;
+	uint16_t *cache_slots = (uint16_t *)(cache_result + CACHE_SEED_RESULT_SIZE / 8); // Right after cache_sizes
 
 	if (index_built)
 	{
@@ -571,7 +801,17 @@ int main()
 		}
 #endif
 
-		map(cache8, cache8bis, cache_seed, cache_sizes, cache_result);
+		// Batches of the ring are mapped back to back, each one is published as soon as all tasklets are done with it
+		uint32_t nb_batches = mailbox.doorbell;
+		for (uint32_t batch = 0; batch < nb_batches; ++batch)
+		{
+			map(batch, cache8, cache8bis, cache_seed, cache_sizes, cache_slots, cache_result);
+			barrier_wait(&barrier_all);
+			if (me() == 0)
+			{
+				mailbox.completed = batch + 1;
+			}
+		}
 
 #ifdef DO_DPU_PERFCOUNTER
 		barrier_wait(&barrier_all);
@@ -0,0 +1,26 @@
+#ifndef BINARY_IO_HPP
+#define BINARY_IO_HPP
+
+#include <fstream>
+
+/// @brief Write a trivially copyable value, or the elements of a contiguous container
+template <typename T>
+void write_binary(const T &data, std::ofstream &out)
+{
+    if constexpr (requires { data.size(); })
+        out.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(typename T::value_type));
+    else
+        out.write(reinterpret_cast<const char *>(&data), sizeof(data));
+}
+
+/// @brief Read a trivially copyable value, or as many elements as the container already holds
+template <typename T>
+void read_binary(T &data, std::ifstream &in)
+{
+    if constexpr (requires { data.size(); })
+        in.read(reinterpret_cast<char *>(data.data()), data.size() * sizeof(typename T::value_type));
+    else
+        in.read(reinterpret_cast<char *>(&data), sizeof(data));
+}
+
+#endif // BINARY_IO_HPP
@@ -1,4 +1,7 @@
+#include <algorithm>
+
 #include "bloom_filter.hpp"
+#include "simd_kernels.hpp"
 
 /* -------------------------------------------------------------------------- */
 /*                              filter static data                            */
@@ -14,22 +17,23 @@ constexpr int BSF_INDEX64[64] = {0, 1, 48, 2, 57, 49, 28, 3, 61, 58, 50, 42, 38,
 /*                              utils functions                               */
 /* -------------------------------------------------------------------------- */
 
-template <typename T>
-void write(const T &data, std::ofstream &out)
+void write_bf_header(std::ofstream &out, uint32_t signature_scheme)
 {
-    if constexpr (requires { data.size(); })
-        out.write(reinterpret_cast<const char *>(data.data()), data.size() * sizeof(typename T::value_type));
-    else
-        out.write(reinterpret_cast<const char *>(&data), sizeof(data));
+    BfFileHeader header{};
+    header.signature_scheme = signature_scheme;
+    write_binary(header, out);
 }
 
-template <typename T>
-void read(T &data, std::ifstream &in)
+void check_bf_header(std::ifstream &in, uint32_t signature_scheme, const std::string &file_path)
 {
-    if constexpr (requires { data.size(); })
-        in.read(reinterpret_cast<char *>(data.data()), data.size() * sizeof(typename T::value_type));
-    else
-        in.read(reinterpret_cast<char *>(&data), sizeof(data));
+    BfFileHeader header{};
+    header.magic = 0;
+    read_binary(header, in);
+    if (!in || header.magic != BfFileHeader::MAGIC)
+        exit(printf("Bloom filter file %s has no valid header (built by an older version?), rebuild it\n", file_path.c_str()));
+    if (header.signature_scheme != signature_scheme)
+        exit(printf("Bloom filter file %s was built with signature scheme %u instead of %u, rebuild it\n", file_path.c_str(),
+                    header.signature_scheme, signature_scheme));
 }
 
 inline uint64_t blsr_u64(uint64_t val)
@@ -90,22 +94,67 @@ LazyBfResult MultiBloomFilter::contains(const hash_t hash1, const hash_t hash2)
     return LazyBfResult({hash1 & m_size_reduced, hash2 & m_size_reduced}, m_data.data(), m_sub_size);
 }
 
-void MultiBloomFilter::save_to_file(std::string file_path) const
+bool MultiBloomFilter::contains_one(const size_t idx, const hash_t hash) const
+{
+    auto pack = m_data[(hash & m_size_reduced) * m_sub_size + (idx >> bf_pack_size2)];
+    return (pack & m_bit_mask[idx & (bf_pack_size - 1)]) != 0;
+}
+
+void MultiBloomFilter::prefetch(const hash_t hash) const
+{
+    const auto *row = m_data.data() + (hash & m_size_reduced) * m_sub_size;
+    for (ssize_t i = 0; i < m_sub_size; i += m_PACKS_PER_CACHE_LINE)
+        __builtin_prefetch(row + i);
+    __builtin_prefetch(row + m_sub_size - 1); // Row may not be aligned on a cache line
+}
+
+void MultiBloomFilter::contains_batch(std::span<const std::pair<hash_t, hash_t>> signatures, BfBatchResult &result) const
+{
+    auto n = signatures.size();
+    result.dpu_ids.clear();
+    result.offsets.resize(n + 1);
+    result.offsets[0] = 0;
+
+    // Issue the first prefetches, then keep m_PREFETCH_DISTANCE queries in flight
+    for (size_t k = 0; k < std::min(n, m_PREFETCH_DISTANCE); ++k)
+    {
+        prefetch(signatures[k].first);
+        prefetch(signatures[k].second);
+    }
+
+    const auto and_rows_decode = simd_kernels().and_rows_decode;
+    for (size_t k = 0; k < n; ++k)
+    {
+        if (k + m_PREFETCH_DISTANCE < n)
+        {
+            prefetch(signatures[k + m_PREFETCH_DISTANCE].first);
+            prefetch(signatures[k + m_PREFETCH_DISTANCE].second);
+        }
+        const auto *row1 = m_data.data() + (signatures[k].first & m_size_reduced) * m_sub_size;
+        const auto *row2 = m_data.data() + (signatures[k].second & m_size_reduced) * m_sub_size;
+        and_rows_decode(row1, row2, m_sub_size, result.dpu_ids);
+        result.offsets[k + 1] = static_cast<uint32_t>(result.dpu_ids.size());
+    }
+}
+
+void MultiBloomFilter::save_to_file(std::string file_path, uint32_t signature_scheme) const
 {
     std::ofstream out(file_path, std::ios::binary);
-    write(m_nb_filters, out);
-    write(m_size2, out);
-    write(m_data, out);
+    write_bf_header(out, signature_scheme);
+    write_binary(m_nb_filters, out);
+    write_binary(m_size2, out);
+    write_binary(m_data, out);
     out.close();
 }
 
-void MultiBloomFilter::load_from_file(std::string file_path)
+void MultiBloomFilter::load_from_file(std::string file_path, uint32_t signature_scheme)
 {
     std::ifstream in(file_path, std::ios::binary);
-    read(m_nb_filters, in);
-    read(m_size2, in);
+    check_bf_header(in, signature_scheme, file_path);
+    read_binary(m_nb_filters, in);
+    read_binary(m_size2, in);
     initialize(m_nb_filters, m_size2);
-    read(m_data, in);
+    read_binary(m_data, in);
     in.close();
 }
 
@@ -121,9 +170,4 @@ std::pair<uint64_t, uint64_t> MultiBloomFilter::place_mask(const size_t idx, con
     auto i = idx >> bf_pack_size2;
     auto h = hash & m_size_reduced;
     return {h * m_sub_size + i, m_bit_mask[idx & (bf_pack_size - 1)]};
-}
-
-void MultiBloomFilter::insert_computed(const uint64_t place, const uint64_t mask)
-{
-    __sync_fetch_and_or(m_data.data() + place, mask);
 }
\ No newline at end of file
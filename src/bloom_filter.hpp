@@ -5,9 +5,12 @@
 #include <cstdint>
 #include <fstream>
 #include <iostream>
+#include <span>
 #include <stdexcept>
 #include <vector>
 
+#include "binary_io.hpp"
+
 /* -------------------------------------------------------------------------- */
 /*                                 Utils for BF                               */
 /* -------------------------------------------------------------------------- */
@@ -19,6 +22,19 @@ using pack_t = uint64_t;
 constexpr ssize_t bf_pack_size2 = 6;
 constexpr ssize_t bf_pack_size = 1 << bf_pack_size2;
 
+/// @brief Header of bloom filter files, filters built with another signature scheme (or older files without
+/// header) must not be used since lookups would not find the same rows
+struct BfFileHeader
+{
+    static constexpr uint64_t MAGIC = 0x3130'7642'4650'4d4d; // "MMPFBv01"
+    uint64_t magic{MAGIC};
+    uint32_t signature_scheme{};
+    uint32_t unused{}; // Unused field, only there to align size on multiple of 8
+};
+
+void write_bf_header(std::ofstream &out, uint32_t signature_scheme);
+void check_bf_header(std::ifstream &in, uint32_t signature_scheme, const std::string &file_path);
+
 template <typename T, size_t S>
 consteval auto generate_bit_mask()
 {
@@ -30,6 +46,16 @@ consteval auto generate_bit_mask()
     return mask;
 }
 
+/// @brief Append the DPU ids of all bits set in a pack, lowest first
+inline void decode_pack(pack_t val, uint32_t base, std::vector<uint32_t> &out)
+{
+    while (val != 0)
+    {
+        out.push_back(base + static_cast<uint32_t>(__builtin_ctzll(val))); // tzcnt with BMI
+        val &= val - 1; // blsr with BMI
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                 Lazy result                                */
 /* -------------------------------------------------------------------------- */
@@ -74,7 +100,24 @@ private:
     pack_t *m_filter;
     ssize_t m_sub_size;
 };
-;
+
+/* -------------------------------------------------------------------------- */
+/*                                Batch result                                */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Result of a batched lookup: flat list of DPU ids with per-query offsets
+struct BfBatchResult
+{
+    std::vector<uint32_t> dpu_ids;
+    std::vector<uint32_t> offsets; // Query i matched dpu_ids[offsets[i]] to dpu_ids[offsets[i + 1]] (excluded)
+    std::vector<std::pair<uint32_t, uint32_t>> candidates; // Scratch for multi-level lookups (query, group)
+
+    size_t size() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    std::span<const uint32_t> operator[](size_t i) const
+    {
+        return {dpu_ids.data() + offsets[i], dpu_ids.data() + offsets[i + 1]};
+    }
+};
 
 /* -------------------------------------------------------------------------- */
 /*                                 BloomFilter                                */
@@ -97,26 +140,38 @@ public:
     /// @param hash hashed item to insert
     void insert(const size_t idx, const hash_t hash);
     LazyBfResult contains(const hash_t hash1, const hash_t hash2);
+    /// @brief Check if one item may be in one of the filters
+    bool contains_one(const size_t idx, const hash_t hash) const;
     auto &data() { return m_data; }
     const auto &data() const { return m_data; }
 
-    void prefetch(const hash_t hash);
+    /// @brief Prefetch in cache the whole row of packs associated to a hash
+    /// @param hash hashed item that will be looked up soon
+    void prefetch(const hash_t hash) const;
+
+    /// @brief Look up a block of queries at once, rows are prefetched ahead and ANDed with SIMD
+    /// @param signatures pair of hashes for each query
+    /// @param result DPU ids matched by each query, in increasing order (buffers are reused between calls)
+    void contains_batch(std::span<const std::pair<hash_t, hash_t>> signatures, BfBatchResult &result) const;
 
     /// @brief Save the data into a file
     /// @param file_path path of the file
-    void save_to_file(std::string file_path) const;
+    /// @param signature_scheme scheme used to compute the inserted hashes
+    void save_to_file(std::string file_path, uint32_t signature_scheme) const;
 
     /// @brief Load from a file
     /// @param file_path pafth of the file
-    void load_from_file(std::string file_path);
+    /// @param signature_scheme scheme that will be used for lookups, must match the one of the file
+    void load_from_file(std::string file_path, uint32_t signature_scheme);
 
     std::pair<uint64_t, uint64_t> place_mask(const size_t idx, const hash_t hash) const;
-    void insert_computed(const uint64_t place, const uint64_t mask);
 
     /// @brief Return size2 of the filters
     /// @return size2
     size_t get_size2() const { return m_size2; }
     ssize_t sub_size() const { return m_sub_size; }
+    size_t nb_filters() const { return static_cast<size_t>(m_nb_filters); }
+    size_t memory_size() const { return m_data.size() * sizeof(pack_t); }
 
     double weight() const;
 
@@ -135,6 +190,8 @@ private:
     static constexpr size_t m_BLOCK_SIZE = (1 << m_BLOCK_SIZE2);
 
     static constexpr int m_MAX_SET_BITS_PER_PACKED_VALUE = 8;
+    static constexpr size_t m_PREFETCH_DISTANCE = 8; // In number of queries
+    static constexpr ssize_t m_PACKS_PER_CACHE_LINE = 64 / sizeof(pack_t);
 };
 
 #endif /* B8927905_A612_4B68_96DB_72B88C732DCB */
@@ -0,0 +1,74 @@
+#ifndef BOUNDED_QUEUE_HPP
+#define BOUNDED_QUEUE_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+
+/// @brief Blocking queue between two pipeline stages, the producer waits when it is full
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(size_t capacity) : m_capacity(capacity) {}
+
+    /// @brief Push an item, waits while the queue is full
+    /// @return false if the queue was closed, the item is dropped
+    bool push(T &&item)
+    {
+        std::unique_lock lock(m_mutex);
+        m_not_full.wait(lock, [this]()
+                        { return m_items.size() < m_capacity || m_closed; });
+        if (m_closed)
+            return false;
+        m_items.push_back(std::move(item));
+        m_not_empty.notify_one();
+        return true;
+    }
+
+    /// @brief Pop an item, waits while the queue is empty and open
+    /// @return false if the queue is closed and empty
+    bool pop(T &item)
+    {
+        std::unique_lock lock(m_mutex);
+        m_not_empty.wait(lock, [this]()
+                         { return !m_items.empty() || m_closed; });
+        if (m_items.empty())
+            return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    /// @brief Pop an item if there is one, without waiting
+    bool try_pop(T &item)
+    {
+        std::lock_guard lock(m_mutex);
+        if (m_items.empty())
+            return false;
+        item = std::move(m_items.front());
+        m_items.pop_front();
+        m_not_full.notify_one();
+        return true;
+    }
+
+    /// @brief No more items can be pushed, wakes up everyone waiting (remaining items can still be popped)
+    void close()
+    {
+        std::lock_guard lock(m_mutex);
+        m_closed = true;
+        m_not_empty.notify_all();
+        m_not_full.notify_all();
+    }
+
+private:
+    size_t m_capacity;
+    bool m_closed{};
+    std::deque<T> m_items;
+    std::mutex m_mutex;
+    std::condition_variable m_not_empty;
+    std::condition_variable m_not_full;
+};
+
+#endif // BOUNDED_QUEUE_HPP
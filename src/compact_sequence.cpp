@@ -1,45 +1,50 @@
-#include <algorithm>
+#include <cstdio>
 
 #include "compact_sequence.hpp"
 #include "read.hpp"
+#include "simd_kernels.hpp"
 
-uint8_t code_4base_n(const char *c)
+size_t new_size(size_t s1, size_t s2)
 {
-    alignas(4) char d[4] = {c[3], c[2], c[1], c[0]};
-    return __builtin_ia32_pext_si(*reinterpret_cast<uint32_t *>(d), 0X06060606);
+    return ((s1 + 3) & ~3) + s2;
 }
 
-size_t new_size(size_t s1, size_t s2)
+void CompactSequence::check_owned() const
 {
-    return ((s1 + 3) & ~3) + s2;
+    if (m_mapped)
+        exit(printf("Cannot modify a mapped CompactSequence\n"));
 }
 
 void CompactSequence::append(const std::string &seq)
 {
-    m_seq_size = new_size(m_seq_size, seq.size());
-    for (size_t i = 0; i < seq.size(); i += 4)
-    {
-        auto c = code_4base_n(seq.data() + i);
-        push_back(c);
-    }
+    append(seq.data(), seq.size());
+}
+
+void CompactSequence::append(const char *seq, size_t nb_bases)
+{
+    check_owned();
+    m_seq_size = new_size(m_seq_size, nb_bases);
+    auto start = data_size();
+    resize(start + (nb_bases + 3) / 4);
+    simd_kernels().encode_bases(seq, nb_bases, data() + start);
 }
 
 void CompactSequence::append(const CompactSequence &cseq2)
 {
+    check_owned();
     m_seq_size = new_size(m_seq_size, cseq2.size());
-    insert(end(), cseq2.begin(), cseq2.end());
+    insert(end(), cseq2.data(), cseq2.data() + cseq2.data_size());
 }
 
 void CompactSequence::append_revcomp(std::string &&seq)
 {
-    std::reverse(seq.begin(), seq.end());
-    complement_read(seq);
-
-    append(std::move(seq));
+    append_revcomp(static_cast<const std::string &>(seq));
 }
 
-void CompactSequence::append_revcomp(const std::string &seq_const)
+void CompactSequence::append_revcomp(const std::string &seq)
 {
-    std::string seq{seq_const};
-    append_revcomp(std::move(seq));
+    // Encode forward, then reverse complement the 2-bit codes in place (no copy of the string)
+    auto start = data_size();
+    append(seq);
+    simd_kernels().revcomp_codes(data() + start, seq.size());
 }
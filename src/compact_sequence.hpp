@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <array>
+#include <memory>
 #include <string>
 
 struct CompactSequence : public std::vector<uint8_t>
@@ -19,22 +20,49 @@ struct CompactSequence : public std::vector<uint8_t>
 
     size_t data_size() const
     {
-        return std::vector<uint8_t>::size();
+        return m_mapped ? m_mapped_size : std::vector<uint8_t>::size();
     }
 
-    uint8_t *data() { return std::vector<uint8_t>::data(); }
-    const uint8_t *data() const { return std::vector<uint8_t>::data(); }
+    uint8_t *data() { return m_mapped ? m_mapped.get() : std::vector<uint8_t>::data(); }
+    const uint8_t *data() const { return m_mapped ? m_mapped.get() : std::vector<uint8_t>::data(); }
 
     uint8_t *data(size_t idx) { return data() + (idx >> 2); }
     const uint8_t *data(size_t idx) const { return data() + (idx >> 2); }
 
     void append(const std::string &seq);
+    void append(const char *seq, size_t nb_bases);
     void append(const CompactSequence &cseq);
     void append_revcomp(std::string &&seq_const);
     void append_revcomp(const std::string &seq_const);
 
+    /// @brief Set the number of bases, new bytes are zeroed (for loaders encoding at precomputed offsets)
+    void resize_bases(size_t nb_bases)
+    {
+        check_owned();
+        m_seq_size = nb_bases;
+        resize((nb_bases + 3) / 4);
+    }
+
+    /// @brief Use mapped bytes (e.g. of a cache file) instead of owned ones, the sequence cannot be modified anymore
+    /// @param bytes encoded bases, the shared pointer keeps the mapping alive
+    /// @param nb_bases number of bases
+    void map(std::shared_ptr<uint8_t> bytes, size_t nb_bases)
+    {
+        clear();
+        shrink_to_fit();
+        m_mapped = std::move(bytes);
+        m_mapped_size = (nb_bases + 3) / 4;
+        m_seq_size = nb_bases;
+    }
+
+    bool is_mapped() const { return m_mapped != nullptr; }
+
 private:
+    void check_owned() const;
+
     size_t m_seq_size = 0;
+    std::shared_ptr<uint8_t> m_mapped; // Set when the bytes are not owned
+    size_t m_mapped_size = 0;
 };
 
 inline uint8_t code_base(char c) { return (c >> 1) & 3; }
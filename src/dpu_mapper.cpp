@@ -1,25 +1,27 @@
+#include <atomic>
 #include <cstdio>
+#include <immintrin.h>
+#include <numeric>
+#include <queue>
+#include <thread>
 
 #include "dpu_mapper.hpp"
 #include "file_utils.hpp"
-#include "signature.hpp"
 
 #include "dpu_mapper_helper.hpp"
+#include "query_reader.hpp"
+#include "reference_cache.hpp"
+#include "reference_loader.hpp"
+#include "simd_kernels.hpp"
 
 /* -------------------------------------------------------------------------- */
 /*                               utils functions                              */
 /* -------------------------------------------------------------------------- */
 
-ssize_t compute_dpu_reference_size(size_t reference_size, ssize_t nb_dpu, ssize_t overlap)
+void print_bloom_filter(const MultiBloomFilter &bf)
 {
-    ssize_t dpu_ref_size = static_cast<ssize_t>(reference_size);
-    dpu_ref_size = dpu_ref_size - ((nb_dpu + 1) * overlap);
-    dpu_ref_size = dpu_ref_size / nb_dpu + (2 * overlap);
-    dpu_ref_size = CEILN<4>(dpu_ref_size); // Align on 4 for the read packing
-    if (dpu_ref_size > 16'000'000)
-        exit(printf("Reference sequence is too long, max 16'000'000, current: %ld\n", dpu_ref_size));
-
-    return dpu_ref_size;
+    printf("Bloom filter: 2^%lu rows, %lu MB, %.3f%% false positive DPUs per lookup\n", bf.get_size2(),
+           bf.memory_size() >> 20, measure_false_positive_rate(bf, bf.nb_filters()) * 100.0);
 }
 
 MultiBloomFilter load_bloom_filter(const std::string &reference_file, ssize_t nb_dpu, ssize_t hash_size)
@@ -29,29 +31,58 @@ MultiBloomFilter load_bloom_filter(const std::string &reference_file, ssize_t nb
     auto bloom_file = generate_bloom_file_path(reference_file, nb_dpu, hash_size);
     validate_file(bloom_file);
     MultiBloomFilter bf{};
-    bf.load_from_file(bloom_file);
-
-    printf("Bloom filter size: %lu\n", bf.get_size2());
+    bf.load_from_file(bloom_file, MapperSignature::scheme());
+    print_bloom_filter(bf);
     return bf;
 }
 
-MultiBloomFilter get_bloom_filter(const std::string &reference_file, const CompactReference &reference, ssize_t nb_dpu, bool create_bf)
+MultiBloomFilter get_bloom_filter(const std::string &reference_file, const CompactReference &reference,
+                                  const ReferencePartition &slices, const ContigRanges &contigs, bool create_bf)
 {
+    auto nb_dpu = static_cast<ssize_t>(slices.nb_dpu());
     if (create_bf)
     {
         printf("Building bloom filter\n");
-        auto bf = build_bloom_filters(reference, nb_dpu, compute_dpu_reference_size(reference.seq.size(), nb_dpu, 400), 400);
-        bf.save_to_file(generate_bloom_file_path(reference_file, nb_dpu, HASH_SIZE));
-        printf("Bloom filter size: %lu\n", bf.get_size2());
+        auto bf = build_bloom_filters(reference, slices, contigs);
+        bf.save_to_file(generate_bloom_file_path(reference_file, nb_dpu, HASH_SIZE), MapperSignature::scheme());
+        print_bloom_filter(bf);
         return bf;
     }
     return load_bloom_filter(reference_file, nb_dpu, HASH_SIZE);
 }
 
-void post_process_mapping(std::vector<MapResults> rank_map_results, std::vector<MapAllArgs> *args,
+HierarchicalBloomFilter get_hierarchical_bloom_filter(const std::string &reference_file, const CompactReference &reference,
+                                                      const std::vector<uint32_t> &rank_start_dpu_id,
+                                                      const ReferencePartition &slices, const ContigRanges &contigs, bool create_bf,
+                                                      double target_fpr)
+{
+    auto nb_dpu = rank_start_dpu_id.back();
+    auto bloom_file = generate_bloom_file_path(reference_file, nb_dpu, HASH_SIZE, HIERARCHICAL_BLOOM_FILTER_EXTENSION);
+    HierarchicalBloomFilter bf{};
+    if (create_bf)
+    {
+        printf("Building hierarchical bloom filter\n");
+        bf = build_hierarchical_bloom_filters(reference, rank_start_dpu_id, slices, contigs, target_fpr);
+        bf.save_to_file(bloom_file, MapperSignature::scheme());
+    }
+    else
+    {
+        printf("Loading hierarchical bloom filter\n");
+        validate_file(bloom_file);
+        bf.load_from_file(bloom_file, MapperSignature::scheme());
+        if (bf.rank_start_dpu_id() != rank_start_dpu_id)
+            exit(printf("Hierarchical bloom filter was built for a different layout of DPUs in ranks\n"));
+    }
+    printf("Hierarchical bloom filter: %lu MB, %.3f%% false positive DPUs per lookup (sized for %.3f%%)\n",
+           bf.memory_size() >> 20, measure_false_positive_rate(bf, nb_dpu) * 100.0, target_fpr * 100.0);
+    return bf;
+}
+
+void post_process_mapping(std::vector<MapResults> rank_map_results, RankArgs *args,
                           size_t dpu_id, MappingWorkerData *mapping_data)
 {
     mapping_data->mutex.lock();
+    auto *latency = mapping_data->latency.get();
     for (size_t k = 0; k < args->size(); ++k)
     {
         auto &map_results = rank_map_results[k];
@@ -60,6 +91,8 @@ void post_process_mapping(std::vector<MapResults> rank_map_results, std::vector<
         for (size_t i = 0; i < n; ++i)
         {
             auto query_id = ids.data[i];
+            if (latency != nullptr)
+                latency->done(query_id);
             auto distance = DECODE_MAP_RESULT_DISTANCE(map_results.data[i]);
             auto &data = mapping_data->result[query_id];
             auto current_distance = data.distance;
@@ -73,6 +106,8 @@ void post_process_mapping(std::vector<MapResults> rank_map_results, std::vector<
                 data.read_size = ids.read_sizes[i];
                 mapping_data->stats.update(distance, current_distance);
             }
+            if (ids.speculative[i])
+                mapping_data->speculation.resolve(query_id, data.distance);
         }
         ++dpu_id;
     }
@@ -80,159 +115,1147 @@ void post_process_mapping(std::vector<MapResults> rank_map_results, std::vector<
     mapping_data->allocator.release(args); // Give the buffer back as available
 }
 
+/// @brief Copy one read slot with non-temporal stores, MapArgs are only read back by the DPU transfers
+inline void stream_slot(uint8_t *dst, const uint8_t *src)
+{
+    for (size_t k = 0; k < READ_SLOT_SIZE; k += sizeof(long long))
+    {
+        long long val;
+        memcpy(&val, src + k, sizeof(val));
+        _mm_stream_si64(reinterpret_cast<long long *>(dst + k), val);
+    }
+}
+
+/// @brief Copy routed query q in the buffer of a DPU, in the shared region of the rank if other DPUs of the rank get
+/// it too and the region is not full, else in the private slots of the DPU
+/// @return slot of the query, as read by the DPU
+uint16_t stage_query(uint32_t q, const ReadBatch &reads, RankArgs &buffer, MapAllArgs &arg, DispatchScratch &scratch)
+{
+    const auto *slot = reads.slot(scratch.reads[q]);
+    if (scratch.rank_hits[q] > 1)
+    {
+        auto &shared = scratch.shared_slots[q];
+        if (shared.buffer == &buffer && shared.generation == buffer.generation)
+            return static_cast<uint16_t>(shared.slot);
+        if (buffer.nb_shared < MAX_SHARED_QUERIES_PER_RANK)
+        {
+            shared = {&buffer, buffer.generation, MAX_NB_QUERIES_PER_DPU + buffer.nb_shared};
+            stream_slot(buffer.shared.queries + READ_SLOT_SIZE * buffer.nb_shared++, slot);
+            return static_cast<uint16_t>(shared.slot);
+        }
+    }
+    stream_slot(arg.dpu_args.queries + READ_SLOT_SIZE * arg.nb_private, slot);
+    return static_cast<uint16_t>(arg.nb_private++);
+}
+
 /* -------------------------------------------------------------------------- */
 /*                               DpuMapper implem                             */
 /* -------------------------------------------------------------------------- */
 
-size_t DpuMapper::dispatch_query(const Read &query, ssize_t shift, MappingWorkerData &mapping_data)
+RankArgs *DpuMapper::acquire_rank_buffer(PimRankID rank_id, MappingWorkerData &mapping_data)
+{
+    RankArgs *args = NULL;
+    while (true)
+    {
+        args = mapping_data.allocator.acquire();
+        if (args != NULL)
+        {
+            break; // Got a buffer
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Got nothing, wait a little bit
+                                                                    // Ranks usually execute in around 5 ms
+    }
+    args->resize(m_rankset.nb_dpu_in_rank(rank_id));
+    for (auto &data : *args)
+    {
+        data.dpu_args.nb_queries = 0;
+        data.nb_private = 0;
+    }
+    args->nb_shared = 0;
+    ++args->generation;
+    return args;
+}
+
+RankArgs &DpuMapper::get_rank_args(PimRankID rank_id, MappingWorkerData &mapping_data)
+{
+    // If no existing buffers for rank, create them
+    auto &args = mapping_data.rank_args[rank_id];
+    if (args == NULL)
+    {
+        args = acquire_rank_buffer(rank_id, mapping_data);
+        mapping_data.staging[rank_id].nb_queries = 0;
+        mapping_data.staging[rank_id].oldest = std::chrono::steady_clock::now();
+    }
+    return *args;
+}
+
+RankArgs &DpuMapper::get_overflow_args(PimRankID rank_id, MappingWorkerData &mapping_data)
+{
+    auto &overflow = mapping_data.staging[rank_id].overflow;
+    if (overflow == NULL)
+        overflow = acquire_rank_buffer(rank_id, mapping_data);
+    return *overflow;
+}
+
+void DpuMapper::launch_rank(PimRankID rank_id, LaunchTrigger trigger, MappingWorkerData &mapping_data)
 {
+    auto &staging = mapping_data.staging[rank_id];
+    auto *args = mapping_data.rank_args[rank_id];
+    if (m_options.launch.latency_mode && trigger != LaunchTrigger::FLUSH && staging.nb_queries > 0)
+    {
+        auto age_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - staging.oldest).count();
+        auto rate = static_cast<double>(staging.nb_queries) / std::max(age_ms, 0.01);
+        staging.arrival_rate = staging.arrival_rate == 0.0 ? rate : 0.75 * staging.arrival_rate + 0.25 * rate;
+    }
+    mapping_data.launch_stats.record(trigger, staging.nb_queries, m_rankset.nb_dpu_in_rank(rank_id) * MAX_NB_QUERIES_PER_DPU);
+    mapping_data.launch_stats.record_transfer(args->max_private() * args->size() + args->nb_shared, staging.nb_queries);
+    launch_mapping(rank_id, args, &mapping_data);
+
+    // Spilled queries are the next ones to go
+    mapping_data.rank_args[rank_id] = staging.overflow;
+    staging.overflow = NULL;
+    staging.nb_queries = 0;
+    staging.oldest = std::chrono::steady_clock::now();
+    if (mapping_data.rank_args[rank_id] != NULL)
+        for (const auto &arg : *mapping_data.rank_args[rank_id])
+            staging.nb_queries += arg.dpu_args.nb_queries;
+}
+
+size_t DpuMapper::launch_threshold(PimRankID rank_id, const RankStaging &staging)
+{
+    const auto &policy = m_options.launch;
+    auto capacity = static_cast<double>(m_rankset.nb_dpu_in_rank(rank_id) * MAX_NB_QUERIES_PER_DPU);
+    auto threshold = static_cast<size_t>(policy.rank_fill * capacity);
+    if (!policy.latency_mode || staging.arrival_rate == 0.0)
+        return threshold;
+
+    // Stage what arrives in half the deadline, the other half is left for the transfers and the DPU run
+    auto expected = static_cast<size_t>(staging.arrival_rate * policy.max_age_ms / 2.0);
+    return std::clamp<size_t>(expected, 1, threshold);
+}
+
+void DpuMapper::launch_old_ranks(MappingWorkerData &mapping_data, double margin_ms)
+{
+    if (m_options.launch.max_age_ms <= 0.0)
+        return;
+    std::lock_guard<std::mutex> lock(mapping_data.staging_mutex);
+    auto now = std::chrono::steady_clock::now();
+    for (PimRankID rank_id = 0; rank_id < m_rankset.nb_ranks(); ++rank_id)
+    {
+        auto &staging = mapping_data.staging[rank_id];
+        if (mapping_data.rank_args[rank_id] != NULL && staging.nb_queries > 0 &&
+            std::chrono::duration<double, std::milli>(now - staging.oldest).count() + margin_ms > m_options.launch.max_age_ms)
+            launch_rank(rank_id, LaunchTrigger::MAX_AGE, mapping_data);
+    }
+}
+
+void DpuMapper::flush_ranks(MappingWorkerData &mapping_data)
+{
+    std::lock_guard<std::mutex> lock(mapping_data.staging_mutex);
+    for (PimRankID rank_id = 0; rank_id < m_rankset.nb_ranks(); ++rank_id)
+    {
+        auto &args = mapping_data.rank_args[rank_id];
+        while (args != NULL && mapping_data.staging[rank_id].nb_queries > 0)
+            launch_rank(rank_id, LaunchTrigger::FLUSH, mapping_data);
+        if (args != NULL)
+        {
+            mapping_data.allocator.release(args); // Nothing staged
+            args = NULL;
+        }
+    }
+}
+
+void clear_pending_routes(DispatchScratch &scratch)
+{
+    scratch.retry_reads.clear();
+    scratch.reads.clear();
+    scratch.start_pos.clear();
+    scratch.routes.dpu_ids.clear();
+    scratch.routes.offsets.assign(1, 0);
+}
+
+/// @brief Add a pending read to scratch.retry_reads, routed to its remaining candidates
+void add_pending_route(uint64_t id, const PendingRead &read, DispatchScratch &scratch)
+{
+    scratch.reads.push_back(static_cast<uint32_t>(scratch.retry_reads.size()));
+    scratch.start_pos.push_back(read.start_pos);
+    scratch.retry_reads.push_back(ReadView{read.slot.codes.data(), read.nb_bases, id});
+    scratch.routes.dpu_ids.insert(scratch.routes.dpu_ids.end(), read.others.begin(), read.others.end());
+    scratch.routes.offsets.push_back(static_cast<uint32_t>(scratch.routes.dpu_ids.size()));
+}
+
+size_t DpuMapper::dispatch_batch(const ReadBatch &reads, ssize_t shift, MappingWorkerData &mapping_data)
+{
+    auto &scratch = mapping_data.dispatch;
+    auto &bf_result = mapping_data.bf_result;
     size_t nb_dispatches = 0;
-    shift = get_round_shift(shift, query.seq.size(), m_min_query_size);
-    auto start_pos = find_good_pos(query, m_seed_search.range, shift);
 
-    auto start_pos2 = find_good_pos(query, start_pos + m_seed_search.delta, shift);
-    auto signatures = Signature<HASH_SIZE>::hash(query, start_pos, start_pos2);
-    for (auto dpu_id : m_bloom_filters.contains(signatures.first, signatures.second))
+    for (size_t block_start = 0; block_start < reads.size(); block_start += DISPATCH_BLOCK_SIZE)
     {
-        dispatch_query_to_dpu(dpu_id, query, start_pos, mapping_data);
-        ++nb_dispatches;
+        // Seeds and signatures of the queries of the block
+        auto block_end = std::min(block_start + DISPATCH_BLOCK_SIZE, reads.size());
+        scratch.reads.clear();
+        scratch.start_pos.clear();
+        scratch.signatures.clear();
+        for (size_t r = block_start; r < block_end; ++r)
+        {
+            auto query = reads[r];
+            if (query.size() < static_cast<size_t>(m_min_query_size) || query.size() > MAX_QUERY_SIZE)
+                continue;
+            auto query_shift = get_round_shift(shift, query.size(), m_min_query_size);
+            auto start_pos = find_good_pos(query, m_seed_search.range, query_shift);
+            auto start_pos2 = find_good_pos(query, start_pos + m_seed_search.delta, query_shift);
+            scratch.reads.push_back(static_cast<uint32_t>(r));
+            scratch.start_pos.push_back(static_cast<uint32_t>(start_pos));
+            scratch.signatures.push_back(MapperSignature::hash(query, start_pos, start_pos2));
+        }
+
+        // Candidate DPUs of all queries at once
+        if (m_options.bloom_routing == BloomRouting::HIERARCHICAL)
+            m_hierarchical_bloom_filters.contains_batch(scratch.signatures, bf_result);
+        else
+            m_bloom_filters.contains_batch(scratch.signatures, bf_result);
+        if (m_replica_start_dpu.size() > 1)
+            assign_replicas(mapping_data);
+        if (!m_slice_copies.empty())
+            spread_hot_slices(mapping_data);
+
+        const BfBatchResult *routes = &bf_result;
+        if (m_options.max_fanout > 0)
+        {
+            cap_fanout(reads, mapping_data);
+            routes = &scratch.capped;
+        }
+        else
+        {
+            for (size_t q = 0; q < scratch.reads.size(); ++q)
+                mapping_data.fanout_stats.record(bf_result[q].size(), bf_result[q].size());
+        }
+
+        scratch.speculative.assign(scratch.reads.size(), 0);
+        if (m_options.speculative_dispatch)
+        {
+            speculate(reads, *routes, mapping_data);
+            routes = &scratch.routes;
+        }
+        nb_dispatches += route_block(reads, *routes, mapping_data);
+        nb_dispatches += dispatch_retries(mapping_data);
+        if (scratch.repeats.size() >= REPEAT_BUFFER_SIZE)
+            nb_dispatches += dispatch_repeats(mapping_data);
+        launch_old_ranks(mapping_data);
     }
+    nb_dispatches += dispatch_repeats(mapping_data); // Repeats do not wait past the batch of their reads
 
     return nb_dispatches;
 }
 
-void DpuMapper::dispatch_query_to_dpu(size_t dpu_id, const Read &query, size_t start_pos, MappingWorkerData &mapping_data)
+size_t DpuMapper::route_block(const ReadBatch &reads, const BfBatchResult &routes, MappingWorkerData &mapping_data)
 {
-    auto rank_id = m_rankset.get_rank_id_of_dpu_id(dpu_id);
-    auto i = dpu_id - m_rankset.get_rank_start_dpu_id(rank_id);
+    auto &scratch = mapping_data.dispatch;
+    const auto nb_dpu = static_cast<size_t>(m_rankset.nb_dpu());
 
-    auto &rank_args = mapping_data.rank_args;
+    // Counting sort of the (query, DPU) pairs by DPU: after the scatter, dpu_ends[d] is the end of DPU d
+    auto &dpu_ends = scratch.dpu_ends;
+    dpu_ends.assign(nb_dpu, 0);
+    for (auto dpu_id : routes.dpu_ids)
+        ++dpu_ends[dpu_id];
+    uint32_t sum = 0;
+    for (auto &count : dpu_ends)
+        sum += std::exchange(count, sum);
+    scratch.sorted.resize(routes.dpu_ids.size());
+    for (size_t q = 0; q < scratch.reads.size(); ++q)
+        for (auto k = routes.offsets[q]; k < routes.offsets[q + 1]; ++k)
+            scratch.sorted[dpu_ends[routes.dpu_ids[k]]++] = static_cast<uint32_t>(q);
 
-    // If no existing buffers for rank, create them
-    if (rank_args[rank_id] == NULL)
+    // Fill the query region of every DPU in one sequential pass, rank by rank: the queries sent to several DPUs of
+    // a rank are counted first, they go to its shared region
+    scratch.rank_hits.assign(scratch.reads.size(), 0);
+    scratch.shared_slots.assign(scratch.reads.size(), {});
+    uint32_t dpu_begin = 0;
+    for (PimRankID rank_id = 0; rank_id < m_rankset.nb_ranks(); ++rank_id)
+    {
+        const size_t rank_start = m_rankset.get_rank_start_dpu_id(rank_id);
+        const size_t rank_end = rank_start + m_rankset.nb_dpu_in_rank(rank_id);
+        const uint32_t rank_begin = dpu_begin;
+        for (auto k = rank_begin; k < dpu_ends[rank_end - 1]; ++k)
+            ++scratch.rank_hits[scratch.sorted[k]];
+
+        for (size_t dpu_id = rank_start; dpu_id < rank_end; ++dpu_id)
+        {
+            if (dpu_ends[dpu_id] > dpu_begin)
+            {
+                append_to_dpu(dpu_id, {scratch.sorted.data() + dpu_begin, dpu_ends[dpu_id] - dpu_begin}, reads, mapping_data);
+                mapping_data.dpu_hits[dpu_id] += dpu_ends[dpu_id] - dpu_begin;
+            }
+            dpu_begin = dpu_ends[dpu_id];
+        }
+
+        for (auto k = rank_begin; k < dpu_begin; ++k)
+            scratch.rank_hits[scratch.sorted[k]] = 0;
+    }
+    return routes.dpu_ids.size();
+}
+
+size_t DpuMapper::pick_candidate(const ReadView &query, std::span<const uint32_t> candidates,
+                                 const std::vector<uint32_t> &loads)
+{
+    static_assert(SPECULATION_NB_PROBES % 2 == 0, "Probes are hashed by pairs");
+    constexpr size_t hash_size = MapperSignature::hash_size();
+    auto least_loaded = [&]()
+    {
+        return static_cast<size_t>(std::min_element(candidates.begin(), candidates.end(), [&loads](uint32_t a, uint32_t b)
+                                                    { return loads[a] < loads[b]; }) -
+                                   candidates.begin());
+    };
+    if (query.size() < hash_size + SPECULATION_NB_PROBES)
+        return least_loaded();
+
+    // Signatures at good seeds spread over the whole read, as the filters only hold those. Each probe takes the first
+    // good seed from its evenly spaced position, the DPU holding most of them is the most likely one.
+    const auto last = query.size() - hash_size;
+    const auto spacing = last / (SPECULATION_NB_PROBES - 1);
+    std::array<size_t, SPECULATION_NB_PROBES> positions{};
+    for (size_t j = 0, next = 0; j < SPECULATION_NB_PROBES; ++j)
+    {
+        auto from = std::min(std::max(next, j * spacing), last);
+        auto range = static_cast<ssize_t>(std::min(spacing, last - from)) - 1;
+        positions[j] = range >= 0 ? static_cast<size_t>(find_good_pos(query, range, from)) : from;
+        next = positions[j] + 1;
+    }
+    std::array<hash_t, SPECULATION_NB_PROBES> probes{};
+    for (size_t j = 0; j < SPECULATION_NB_PROBES; j += 2)
+        std::tie(probes[j], probes[j + 1]) = MapperSignature::hash(query, positions[j], positions[j + 1]);
+
+    // Ties, including reads without any probe in the filters, go to the least loaded candidate
+    size_t best = 0, best_score = 0;
+    for (size_t c = 0; c < candidates.size(); ++c)
+    {
+        size_t score = 0;
+        for (auto h : probes)
+            score += m_options.bloom_routing == BloomRouting::HIERARCHICAL ? m_hierarchical_bloom_filters.contains_one(m_dpu_slice[candidates[c]], h)
+                                                                           : m_bloom_filters.contains_one(m_dpu_slice[candidates[c]], h);
+        if (c == 0 || score > best_score || (score == best_score && loads[candidates[c]] < loads[candidates[best]]))
+        {
+            best = c;
+            best_score = score;
+        }
+    }
+    return best;
+}
+
+void DpuMapper::assign_replicas(MappingWorkerData &mapping_data)
+{
+    auto &scratch = mapping_data.dispatch;
+    auto &bf_result = mapping_data.bf_result;
+    const auto nb_replicas = m_replica_start_dpu.size();
+    auto &loads = scratch.replica_loads;
+    if (m_options.replica_policy == ReplicaPolicy::LEAST_LOADED)
+    {
+        loads.assign(nb_replicas, 0);
+        std::lock_guard<std::mutex> lock(mapping_data.staging_mutex);
+        for (size_t g = 0; g < nb_replicas; ++g)
+            for (auto rank_id = m_replica_start_rank[g]; rank_id < m_replica_start_rank[g + 1]; ++rank_id)
+                loads[g] += mapping_data.staging[rank_id].nb_queries;
+    }
+
+    // All the candidates of a read go to the same replica
+    for (size_t q = 0; q < scratch.reads.size(); ++q)
+    {
+        size_t replica = 0;
+        if (m_options.replica_policy == ReplicaPolicy::LEAST_LOADED)
+        {
+            replica = static_cast<size_t>(std::min_element(loads.begin(), loads.end()) - loads.begin());
+            loads[replica] += bf_result.offsets[q + 1] - bf_result.offsets[q];
+        }
+        else
+            replica = scratch.next_replica++ % nb_replicas;
+        for (auto k = bf_result.offsets[q]; k < bf_result.offsets[q + 1]; ++k)
+            bf_result.dpu_ids[k] += static_cast<uint32_t>(m_replica_start_dpu[replica]);
+    }
+}
+
+void DpuMapper::spread_hot_slices(MappingWorkerData &mapping_data)
+{
+    auto &loads = mapping_data.dispatch.dpu_loads;
+    snapshot_dpu_loads(mapping_data);
+    for (auto &dpu_id : mapping_data.bf_result.dpu_ids)
+    {
+        for (auto copy : m_slice_copies[m_dpu_slice[dpu_id]])
+            if (loads[copy] < loads[dpu_id])
+                dpu_id = copy;
+        ++loads[dpu_id];
+    }
+}
+
+void DpuMapper::snapshot_dpu_loads(MappingWorkerData &mapping_data)
+{
+    auto &loads = mapping_data.dispatch.dpu_loads;
+    loads.assign(static_cast<size_t>(m_rankset.nb_dpu()), 0);
+    std::lock_guard<std::mutex> lock(mapping_data.staging_mutex);
+    for (PimRankID rank_id = 0; rank_id < m_rankset.nb_ranks(); ++rank_id)
+    {
+        auto start = m_rankset.get_rank_start_dpu_id(rank_id);
+        for (auto *args : {mapping_data.rank_args[rank_id], mapping_data.staging[rank_id].overflow})
+            if (args != NULL)
+                for (size_t i = 0; i < args->size(); ++i)
+                    loads[start + i] += (*args)[i].dpu_args.nb_queries;
+    }
+}
+
+void DpuMapper::cap_fanout(const ReadBatch &reads, MappingWorkerData &mapping_data)
+{
+    auto &scratch = mapping_data.dispatch;
+    const auto &bf_result = mapping_data.bf_result;
+    const auto max_fanout = m_options.max_fanout;
+    const auto policy = m_options.fanout_policy;
+    auto &capped = scratch.capped;
+    auto &loads = scratch.dpu_loads;
+    capped.dpu_ids.clear();
+    capped.offsets.assign(1, 0);
+    if (policy == FanoutPolicy::LEAST_LOADED)
+        snapshot_dpu_loads(mapping_data);
+
+    for (size_t q = 0; q < scratch.reads.size(); ++q)
+    {
+        auto candidates = bf_result[q];
+        if (candidates.size() <= max_fanout)
+        {
+            capped.dpu_ids.insert(capped.dpu_ids.end(), candidates.begin(), candidates.end());
+            mapping_data.fanout_stats.record(candidates.size(), candidates.size());
+        }
+        else if (policy == FanoutPolicy::LEAST_LOADED)
+        {
+            auto &sorted = scratch.candidates;
+            sorted.assign(candidates.begin(), candidates.end());
+            std::partial_sort(sorted.begin(), sorted.begin() + static_cast<ssize_t>(max_fanout), sorted.end(),
+                              [&loads](uint32_t a, uint32_t b)
+                              { return loads[a] < loads[b]; });
+            capped.dpu_ids.insert(capped.dpu_ids.end(), sorted.begin(), sorted.begin() + static_cast<ssize_t>(max_fanout));
+            mapping_data.fanout_stats.record(candidates.size(), max_fanout);
+        }
+        else if (policy == FanoutPolicy::ROUND_ROBIN)
+        {
+            auto first = scratch.round_robin++ % candidates.size();
+            for (size_t j = 0; j < max_fanout; ++j)
+                capped.dpu_ids.push_back(candidates[(first + j) % candidates.size()]);
+            mapping_data.fanout_stats.record(candidates.size(), max_fanout);
+        }
+        else
+        {
+            auto query = reads[scratch.reads[q]];
+            PendingRead repeat{{}, static_cast<uint32_t>(query.size()), scratch.start_pos[q], {candidates.begin(), candidates.end()}};
+            std::copy_n(query.codes, READ_SLOT_SIZE, repeat.slot.codes.data());
+            scratch.repeats.emplace_back(query.id, std::move(repeat));
+            mapping_data.fanout_stats.record(candidates.size(),
+                                             std::min(candidates.size(), REPEAT_FANOUT_FACTOR * max_fanout));
+        }
+        if (policy == FanoutPolicy::LEAST_LOADED)
+            for (auto k = capped.offsets.back(); k < capped.dpu_ids.size(); ++k)
+                ++loads[capped.dpu_ids[k]];
+        capped.offsets.push_back(static_cast<uint32_t>(capped.dpu_ids.size()));
+    }
+}
+
+void DpuMapper::speculate(const ReadBatch &reads, const BfBatchResult &candidates_of, MappingWorkerData &mapping_data)
+{
+    auto &scratch = mapping_data.dispatch;
+    auto &routes = scratch.routes;
+    routes.dpu_ids.clear();
+    routes.offsets.assign(1, 0);
+    scratch.new_pending.clear();
+    auto &loads = scratch.dpu_loads;
+    snapshot_dpu_loads(mapping_data);
+    for (size_t q = 0; q < scratch.reads.size(); ++q)
+    {
+        auto candidates = candidates_of[q];
+        if (candidates.size() > 1)
+        {
+            auto query = reads[scratch.reads[q]];
+            auto best = pick_candidate(query, candidates, loads);
+            routes.dpu_ids.push_back(candidates[best]);
+            ++loads[candidates[best]];
+
+            PendingRead pending{{}, static_cast<uint32_t>(query.size()), scratch.start_pos[q], {}};
+            std::copy_n(query.codes, READ_SLOT_SIZE, pending.slot.codes.data());
+            pending.others.assign(candidates.begin(), candidates.end());
+            pending.others.erase(pending.others.begin() + static_cast<ssize_t>(best));
+            scratch.new_pending.emplace_back(query.id, std::move(pending));
+            scratch.speculative[q] = 1;
+        }
+        else
+            routes.dpu_ids.insert(routes.dpu_ids.end(), candidates.begin(), candidates.end());
+        routes.offsets.push_back(static_cast<uint32_t>(routes.dpu_ids.size()));
+    }
+
+    // Registered before the queries are staged, a result may come back as soon as their rank is launched
+    std::lock_guard<std::mutex> lock(mapping_data.mutex);
+    auto &speculation = mapping_data.speculation;
+    speculation.nb_speculative += scratch.new_pending.size();
+    for (auto &[id, pending] : scratch.new_pending)
+        speculation.pending.emplace(id, std::move(pending));
+}
+
+size_t DpuMapper::dispatch_retries(MappingWorkerData &mapping_data)
+{
+    if (!m_options.speculative_dispatch)
+        return 0;
+
+    auto &scratch = mapping_data.dispatch;
+    clear_pending_routes(scratch);
+    {
+        std::lock_guard<std::mutex> lock(mapping_data.mutex);
+        auto &speculation = mapping_data.speculation;
+        for (auto id : speculation.failed)
+        {
+            auto node = speculation.pending.extract(id);
+            if (node.empty()) // Failed twice, already fanned out
+                continue;
+            add_pending_route(id, node.mapped(), scratch);
+            ++speculation.nb_fanned_out;
+        }
+        speculation.failed.clear();
+    }
+    if (scratch.reads.empty())
+        return 0;
+    scratch.speculative.assign(scratch.reads.size(), 0);
+    return route_block(scratch.retry_reads, scratch.routes, mapping_data);
+}
+
+size_t DpuMapper::dispatch_repeats(MappingWorkerData &mapping_data)
+{
+    auto &scratch = mapping_data.dispatch;
+    if (scratch.repeats.empty())
+        return 0;
+
+    // Each repeat goes to its least loaded candidates, with the loads of the queries staged so far
+    const auto repeat_fanout = REPEAT_FANOUT_FACTOR * m_options.max_fanout;
+    auto &loads = scratch.dpu_loads;
+    snapshot_dpu_loads(mapping_data);
+    size_t nb_dispatches = 0;
+    for (size_t first = 0; first < scratch.repeats.size(); first += DISPATCH_BLOCK_SIZE)
     {
-        while (true)
+        clear_pending_routes(scratch);
+        for (size_t k = first; k < std::min(first + DISPATCH_BLOCK_SIZE, scratch.repeats.size()); ++k)
         {
-            rank_args[rank_id] = mapping_data.allocator.acquire();
-            if (rank_args[rank_id] != NULL)
+            auto &others = scratch.repeats[k].second.others;
+            if (others.size() > repeat_fanout)
             {
-                break; // Got a buffer
+                std::partial_sort(others.begin(), others.begin() + static_cast<ssize_t>(repeat_fanout), others.end(),
+                                  [&loads](uint32_t a, uint32_t b)
+                                  { return loads[a] < loads[b]; });
+                others.resize(repeat_fanout);
             }
-            std::this_thread::sleep_for(std::chrono::milliseconds(10)); // Got nothing, wait a little bit
-                                                                        // Ranks usually execute in around 5 ms
+            for (auto dpu_id : others)
+                ++loads[dpu_id];
+            add_pending_route(scratch.repeats[k].first, scratch.repeats[k].second, scratch);
         }
-        rank_args[rank_id]->resize(m_rankset.nb_dpu_in_rank(rank_id));
-        for (auto &data : *(rank_args[rank_id]))
-            data.dpu_args.nb_queries = 0;
+        scratch.speculative.assign(scratch.reads.size(), 0);
+        nb_dispatches += route_block(scratch.retry_reads, scratch.routes, mapping_data);
     }
+    scratch.repeats.clear();
+    return nb_dispatches;
+}
 
-    auto &args = rank_args[rank_id];
-    auto &arg = (*args)[i];
+void DpuMapper::append_to_dpu(size_t dpu_id, std::span<const uint32_t> queries, const ReadBatch &reads,
+                              MappingWorkerData &mapping_data)
+{
+    auto &scratch = mapping_data.dispatch;
+    const auto &policy = m_options.launch;
+    auto rank_id = m_rankset.get_rank_id_of_dpu_id(dpu_id);
+    auto i = dpu_id - m_rankset.get_rank_start_dpu_id(rank_id);
+    std::lock_guard<std::mutex> lock(mapping_data.staging_mutex);
+    auto &staging = mapping_data.staging[rank_id];
+    const auto rank_fill_threshold = launch_threshold(rank_id, staging);
 
-    // Add item to args
-    memcpy(arg.dpu_args.queries + static_cast<size_t>((MAX_QUERY_SIZE / 4) * arg.dpu_args.nb_queries), query.seq.data(),
-           query.seq.data_size() * sizeof(uint8_t));
-    arg.dpu_args.seed_positions[arg.dpu_args.nb_queries] = start_pos;
-    auto size = static_cast<uint8_t>(query.seq.size() - 1);
-    arg.dpu_args.query_sizes[arg.dpu_args.nb_queries] = size;
-    arg.identifiers.data[arg.dpu_args.nb_queries] = query.id;
-    arg.identifiers.read_sizes[arg.dpu_args.nb_queries] = size;
-    if (++arg.dpu_args.nb_queries >= MAX_NB_QUERIES_PER_DPU)
+    for (size_t k = 0; k < queries.size();)
     {
-        // If target buffer become full, launch rank
-        launch_mapping(rank_id, args, &mapping_data);
-        rank_args[rank_id] = NULL;
+        auto *buffer = &get_rank_args(rank_id, mapping_data);
+        bool spilled = (*buffer)[i].dpu_args.nb_queries >= MAX_NB_QUERIES_PER_DPU; // Only with an overflow area
+        if (spilled)
+            buffer = &get_overflow_args(rank_id, mapping_data);
+        auto *arg = &(*buffer)[i];
+
+        auto first = arg->dpu_args.nb_queries;
+        auto n = std::min<size_t>(queries.size() - k, MAX_NB_QUERIES_PER_DPU - first);
+        for (size_t j = 0; j < n; ++j)
+        {
+            auto q = queries[k + j];
+            auto r = scratch.reads[q];
+            arg->dpu_args.query_slots[first + j] = stage_query(q, reads, *buffer, *arg, scratch);
+            auto size = static_cast<uint8_t>(reads.read_size(r) - 1);
+            arg->dpu_args.seed_positions[first + j] = scratch.start_pos[q];
+            arg->dpu_args.query_sizes[first + j] = size;
+            arg->identifiers.data[first + j] = reads.id(r);
+            arg->identifiers.read_sizes[first + j] = size;
+            arg->identifiers.speculative[first + j] = scratch.speculative[q];
+        }
+        arg->dpu_args.nb_queries += static_cast<uint32_t>(n);
+        k += n;
+        if (!spilled)
+            staging.nb_queries += n;
+
+        // A full DPU launches the rank, unless it can still spill into the overflow area
+        if (arg->dpu_args.nb_queries >= MAX_NB_QUERIES_PER_DPU && (spilled || !policy.overflow))
+            launch_rank(rank_id, LaunchTrigger::FULL_DPU, mapping_data);
+        else if (staging.nb_queries >= rank_fill_threshold)
+            launch_rank(rank_id, LaunchTrigger::RANK_FILL, mapping_data);
     }
 }
 
-DpuMapper::DpuMapper(const std::string &reference_path, ssize_t nb_ranks, bool create_bf) : m_rankset(nb_ranks, nb_ranks), m_overlap(400)
+DpuMapper::DpuMapper(const std::string &reference_path, ssize_t nb_ranks, bool create_bf, const DpuMapperOptions &options)
+    : m_rankset(nb_ranks, nb_ranks), m_overlap(400), m_reference_path(reference_path), m_options(options)
 {
-    m_rankset.initialize(DpuProfile{}, "./dpu/short_read_mapping");
+    m_rankset.initialize(DpuProfile{}); // Programs are loaded per rank, to fit the slices of the rank
+    m_rank_index_config.assign(static_cast<size_t>(m_rankset.nb_ranks()), AUTO_INDEX_CONFIG);
     printf("Using %zu real PIM hardware ranks (%zu DPUs)\n", m_rankset.nb_ranks(), m_rankset.nb_dpu());
+    printf("Using %s host kernels\n", simd_kernels().name);
+    initialize_replicas();
+    if (m_options.minimizer_window > MAX_MINIMIZER_WINDOW)
+        exit(printf("Minimizer windows hold at most %u seeds\n", MAX_MINIMIZER_WINDOW));
+    if (m_options.nb_passes == 0)
+        exit(printf("Mapping needs at least one pass\n"));
+    const auto replica_ranks = static_cast<ssize_t>((m_replica_start_rank[1] - m_replica_start_rank[0]) * m_options.nb_passes);
 
-    printf("Loading reference\n");
-    graal::Bank reference_bank(reference_path);
-    m_reference = load_and_compress_reference(reference_bank, nb_ranks);
+    auto cache_path = generate_reference_cache_path(reference_path);
+    if (m_options.use_reference_cache && load_reference_cache(cache_path, reference_path, m_reference))
+    {
+        printf("Reference mapped from %s\n", cache_path.c_str());
+        check_reference_size(static_cast<ssize_t>(m_reference.seq.size() / 2), replica_ranks);
+    }
+    else
+    {
+        printf("Loading reference\n");
+        m_reference = load_reference_parallel(reference_path, replica_ranks);
+        if (m_options.write_reference_cache)
+        {
+            printf("Saving reference cache %s\n", cache_path.c_str());
+            save_reference_cache(cache_path, reference_path, m_reference);
+        }
+    }
 
-    m_dpu_ref_size = compute_dpu_reference_size(m_reference.seq.size(), m_rankset.nb_dpu(), m_overlap);
+    // Contigs of both strands, to pack the slices and to leave the junction signatures out of the filters
+    auto contigs = m_options.contig_packing ? contig_ranges(m_reference) : ContigRanges{};
+    m_full_partition = get_partition(reference_path, contigs, create_bf);
+    if (!m_options.hot_slices_path.empty())
+    {
+        LoadProfile hint{};
+        hint.load_from_file(m_options.hot_slices_path);
+        if (hint.start_pos != m_full_partition.start_positions())
+            exit(printf("Hot slices of %s are not the slices of this partition\n", m_options.hot_slices_path.c_str()));
+        m_hot_slice_hint = std::move(hint.hits);
+    }
 
-    m_bloom_filters = get_bloom_filter(reference_path, m_reference, m_rankset.nb_dpu(), create_bf);
+    // Filters of the other passes are saved, the ones of the first pass are kept. Without create_bf, only the filters
+    // missing from the ones saved with the partition are built.
+    for (auto pass = m_options.nb_passes - 1; pass > 0; --pass)
+        if (create_bf || !std::filesystem::exists(pass_bloom_file_path(pass)))
+            load_pass_filters(pass, true, contigs);
+    load_pass_filters(0, create_bf || !std::filesystem::exists(pass_bloom_file_path(0)), contigs);
 
     printf("Building index\n");
+    index_pass();
+    printf("Index built\n");
+}
+
+std::string DpuMapper::pass_reference_path(size_t pass) const
+{
+    return m_options.nb_passes > 1 ? m_reference_path + "_pass" + std::to_string(pass) : m_reference_path;
+}
+
+std::string DpuMapper::pass_bloom_file_path(size_t pass) const
+{
+    auto extension = m_options.bloom_routing == BloomRouting::HIERARCHICAL ? HIERARCHICAL_BLOOM_FILTER_EXTENSION : BLOOM_FILTER_EXTENSION;
+    return generate_bloom_file_path(pass_reference_path(pass), m_nb_slices, HASH_SIZE, extension);
+}
+
+void DpuMapper::load_pass_filters(size_t pass, bool create_bf, const ContigRanges &contigs)
+{
+    m_pass = pass;
+    m_partition = m_full_partition.subset(pass * m_nb_slices, m_nb_slices);
+    if (m_options.nb_passes > 1)
+        printf("Pass %zu: reference from %zu\n", pass, m_partition.start_pos(0));
+
+    auto reference_path = pass_reference_path(pass);
+    if (m_options.bloom_routing == BloomRouting::HIERARCHICAL)
+    {
+        // Filters cover the slices, laid out as the ranks of the first replica
+        std::vector<uint32_t> rank_start_dpu_id;
+        for (PimRankID rank_id = 0; rank_id < m_replica_start_rank[1]; ++rank_id)
+            rank_start_dpu_id.push_back(static_cast<uint32_t>(std::min(m_rankset.get_rank_start_dpu_id(rank_id), m_nb_slices)));
+        rank_start_dpu_id.push_back(static_cast<uint32_t>(m_nb_slices));
+        m_hierarchical_bloom_filters = get_hierarchical_bloom_filter(reference_path, m_reference, rank_start_dpu_id, m_partition, contigs, create_bf,
+                                                                     m_options.hierarchical_fpr);
+    }
+    else
+        m_bloom_filters = get_bloom_filter(reference_path, m_reference, m_partition, contigs, create_bf);
+}
+
+void DpuMapper::index_pass()
+{
+    auto start = std::chrono::steady_clock::now();
     build_index();
+    if (!m_hot_slice_hint.empty())
+    {
+        auto first = m_hot_slice_hint.begin() + static_cast<ssize_t>(m_pass * m_nb_slices);
+        assign_hot_slices({first, first + static_cast<ssize_t>(m_nb_slices)});
+    }
     m_rankset.wait_all_ranks_done();
-    printf("Index built\n");
+    m_padded_slices.clear();
+
+    report_index(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
 }
 
-void DpuMapper::build_index()
+void DpuMapper::report_index(double seconds)
 {
-    index_args.seq_size = m_dpu_ref_size;
+    FILE *stats_file = nullptr;
+    if (!m_options.index_stats_path.empty())
+    {
+        stats_file = fopen(m_options.index_stats_path.c_str(), m_pass == 0 ? "w" : "a");
+        if (stats_file == nullptr)
+            exit(printf("Cannot write index statistics to %s\n", m_options.index_stats_path.c_str()));
+        if (m_pass == 0)
+            fprintf(stats_file, "pass\tdpu\tslice\tconfig\tpositions\tcells\tcandidates_per_seed\tcollision_rate\n");
+    }
 
-    m_dpu_start_pos.reserve(m_rankset.nb_dpu());
-    size_t start_pos = 0;
+    uint64_t nb_positions = 0;
+    double max_candidates = 0.0, max_collisions = 0.0, sum_candidates = 0.0, sum_collisions = 0.0;
+    size_t max_candidates_dpu = 0, max_collisions_dpu = 0, nb_dpu = 0;
+    std::vector<size_t> config_ranks(NB_DPU_INDEX_CONFIGS, 0);
     for (PimRankID rank_id = 0; rank_id < m_rankset.nb_ranks(); ++rank_id)
     {
-        size_t nb_dpu_in_rank = m_rankset.nb_dpu_in_rank(rank_id);
-        std::vector<uint8_t *> buffers(nb_dpu_in_rank);
-        for (size_t dpu_id = 0; dpu_id < nb_dpu_in_rank; ++dpu_id)
+        auto config = m_rank_index_config[rank_id];
+        if (config == AUTO_INDEX_CONFIG)
+            continue;
+        config_ranks[config]++;
+        auto stats = m_rankset.get_data_from_rank_sync<IndexStats>(rank_id, "index_stats", 0, sizeof(IndexStats));
+        auto rank_start = m_rankset.get_rank_start_dpu_id(rank_id);
+        for (size_t i = 0; i < stats.size(); ++i)
+        {
+            const auto &s = stats[i];
+            auto candidates = static_cast<double>(s.sum_squared_cnt) / static_cast<double>(std::max<uint64_t>(s.nb_positions, 1));
+            auto collisions = static_cast<double>(s.nb_collisions) / static_cast<double>(std::max<uint64_t>(s.nb_sampled, 1));
+            nb_positions += s.nb_positions;
+            sum_candidates += candidates;
+            sum_collisions += collisions;
+            nb_dpu++;
+            if (candidates > max_candidates)
+            {
+                max_candidates = candidates;
+                max_candidates_dpu = rank_start + i;
+            }
+            if (collisions > max_collisions)
+            {
+                max_collisions = collisions;
+                max_collisions_dpu = rank_start + i;
+            }
+            if (stats_file != nullptr)
+                fprintf(stats_file, "%zu\t%zu\t%u\t%s\t%lu\t%lu\t%.3f\t%.5f\n", m_pass, rank_start + i, m_dpu_slice[rank_start + i],
+                        index_config_name(config).c_str(), s.nb_positions, s.nb_cells, candidates, collisions);
+        }
+    }
+    if (stats_file != nullptr)
+        fclose(stats_file);
+
+    printf("Index: %lu positions (%.1f MB of position tables) in %.2f s", nb_positions,
+           static_cast<double>(nb_positions) * POS_BITS / 8.0 / 1e6, seconds);
+    if (m_options.minimizer_window > 1)
+        printf(", minimizers of windows of %u seeds", m_options.minimizer_window);
+    printf("\nIndex programs (table bits:seed bases):");
+    for (size_t config = 0; config < NB_DPU_INDEX_CONFIGS; ++config)
+        if (config_ranks[config] > 0)
+            printf(" %s on %zu ranks", index_config_name(config).c_str(), config_ranks[config]);
+    nb_dpu = std::max<size_t>(nb_dpu, 1);
+    printf("\nCandidates per seed: %.2f mean, %.2f max (DPU %zu). Collisions: %.2f%% mean, %.2f%% max (DPU %zu)\n",
+           sum_candidates / static_cast<double>(nb_dpu), max_candidates, max_candidates_dpu,
+           100.0 * sum_collisions / static_cast<double>(nb_dpu), 100.0 * max_collisions, max_collisions_dpu);
+}
+
+uint64_t DpuMapper::count_verifications()
+{
+    uint64_t nb_verifications = 0;
+    for (PimRankID rank_id = 0; rank_id < m_rankset.nb_ranks(); ++rank_id)
+        if (m_rank_index_config[rank_id] != AUTO_INDEX_CONFIG)
+            nb_verifications += m_rankset.get_reduced_sum_from_rank_sync<uint64_t>(rank_id, "nb_verifications", 0, sizeof(uint64_t));
+    return nb_verifications;
+}
+
+void DpuMapper::load_pass(size_t pass)
+{
+    printf("Loading pass %zu\n", pass);
+    load_pass_filters(pass, false, {});
+
+    // Ranks get a new program with their index, spare DPUs hold no slice again. The slices are indexed again rather than
+    // restored: cnt_table and pos_table could be read back and sent again like any MRAM symbol, but an image is the
+    // 48 MB index plus the 6 MB slice of every DPU (138 GB per pass on 2560 DPUs) to store and reload, against 6 MB
+    // per DPU sent for the index run.
+    std::fill(m_dpu_slice.begin() + static_cast<ssize_t>(spare_start_dpu()), m_dpu_slice.end(), 0);
+    std::fill(m_rank_index_config.begin() + m_spare_start_rank, m_rank_index_config.end(), AUTO_INDEX_CONFIG);
+    m_slice_copies.clear();
+    m_hot_slices_assigned = false;
+    index_pass();
+}
+
+void DpuMapper::initialize_replicas()
+{
+    if (m_options.spare_ranks >= static_cast<size_t>(m_rankset.nb_ranks()))
+        exit(printf("%zu spare ranks leave no rank for the reference\n", m_options.spare_ranks));
+    const auto nb_ranks = static_cast<size_t>(m_rankset.nb_ranks()) - m_options.spare_ranks;
+    m_spare_start_rank = static_cast<PimRankID>(nb_ranks);
+    const auto replica_ranks = m_options.replica_ranks == 0 ? nb_ranks : m_options.replica_ranks;
+    if (replica_ranks > nb_ranks)
+        exit(printf("Replicas of %zu ranks need more than the %zu ranks available\n", replica_ranks, nb_ranks));
+
+    // Ranks left over join the last replica, slices are the DPUs of the smallest replica
+    const auto nb_replicas = nb_ranks / replica_ranks;
+    m_replica_start_rank.clear();
+    m_replica_start_dpu.clear();
+    for (size_t g = 0; g < nb_replicas; ++g)
+    {
+        m_replica_start_rank.push_back(static_cast<PimRankID>(g * replica_ranks));
+        m_replica_start_dpu.push_back(m_rankset.get_rank_start_dpu_id(static_cast<PimRankID>(g * replica_ranks)));
+    }
+    m_replica_start_rank.push_back(static_cast<PimRankID>(nb_ranks));
+    m_nb_slices = std::numeric_limits<size_t>::max();
+    for (size_t g = 0; g < nb_replicas; ++g)
+    {
+        auto end = g + 1 < nb_replicas ? m_replica_start_dpu[g + 1] : spare_start_dpu();
+        m_nb_slices = std::min(m_nb_slices, end - m_replica_start_dpu[g]);
+    }
+
+    // Spare DPUs hold no slice until they take copies of the hot ones
+    m_dpu_slice.assign(static_cast<size_t>(m_rankset.nb_dpu()), 0);
+    for (size_t g = 0, dpu_id = 0; dpu_id < spare_start_dpu(); ++dpu_id)
+    {
+        if (g + 1 < nb_replicas && dpu_id >= m_replica_start_dpu[g + 1])
+            ++g;
+        m_dpu_slice[dpu_id] = static_cast<uint32_t>((dpu_id - m_replica_start_dpu[g]) % m_nb_slices);
+    }
+    if (m_options.spare_ranks > 0)
+        printf("%zu spare ranks for the hot slices\n", m_options.spare_ranks);
+    if (nb_replicas > 1)
+        printf("Reference replicated %zu times, over %zu ranks (%zu DPUs) each\n", nb_replicas, replica_ranks, m_nb_slices);
+}
+
+ReferencePartition DpuMapper::get_partition(const std::string &reference_path, const ContigRanges &contigs, bool &create_bf)
+{
+    const auto nb_dpu = m_nb_slices * m_options.nb_passes;
+    const auto reference_size = m_reference.seq.size();
+    const auto source = compute_reference_fingerprint(reference_path);
+    auto partition_path = generate_partition_path(reference_path, nb_dpu);
+    ReferencePartition partition{};
+    if (!create_bf && std::filesystem::exists(partition_path))
+    {
+        // Filters were built by the index app for the partition saved with them, whatever options made it
+        partition.load_from_file(partition_path);
+        if (partition.nb_dpu() != nb_dpu)
+            exit(printf("Partition %s is for %zu DPUs instead of %zu\n", partition_path.c_str(), partition.nb_dpu(), nb_dpu));
+        if (partition.built_from(source, reference_size))
+        {
+            printf("Partition loaded from %s: slices of %zu to %zu bases\n", partition_path.c_str(), partition.min_size(),
+                   partition.max_size());
+            return partition;
+        }
+        printf("Partition %s was built for another reference\n", partition_path.c_str());
+    }
+
+    // A new partition makes every saved filter stale
+    if (!create_bf)
+        printf("Building the partition and the bloom filters of %s\n", reference_path.c_str());
+    create_bf = true;
+
+    if (!m_options.load_profile_path.empty() && m_options.contig_packing)
+        exit(printf("A load balanced partition cannot be packed by contigs\n"));
+    if (!m_options.load_profile_path.empty())
+    {
+        LoadProfile profile{};
+        profile.load_from_file(m_options.load_profile_path);
+        partition = ReferencePartition::balanced(reference_size, nb_dpu, static_cast<size_t>(m_overlap), profile);
+        printf("Load balanced partition from %s: slices of %zu to %zu bases\n", m_options.load_profile_path.c_str(),
+               partition.min_size(), partition.max_size());
+    }
+    else if (m_options.contig_packing)
+    {
+        partition = ReferencePartition::contig_packed(reference_size, nb_dpu, static_cast<size_t>(m_overlap), contigs);
+        printf("Partition packed by contigs: slices of %zu to %zu bases\n", partition.min_size(), partition.max_size());
+    }
+    else
+        partition = ReferencePartition::uniform(reference_size, nb_dpu, static_cast<size_t>(m_overlap));
+
+    partition.save_to_file(partition_path, source, reference_size);
+    return partition;
+}
+
+void DpuMapper::build_index()
+{
+    m_dpu_start_pos.resize(m_dpu_slice.size());
+    for (size_t dpu_id = 0; dpu_id < m_dpu_slice.size(); ++dpu_id)
+        m_dpu_start_pos[dpu_id] = m_partition.start_pos(m_dpu_slice[dpu_id]);
+    m_index_args.resize(m_dpu_slice.size());
+    m_slice_seeds.resize(m_nb_slices);
+    const auto nb_slices = static_cast<ssize_t>(m_nb_slices);
+#pragma omp parallel for schedule(dynamic)
+    for (ssize_t slice = 0; slice < nb_slices; ++slice)
+        m_slice_seeds[slice] = count_good_seeds(m_reference.seq, m_partition.start_pos(slice), m_partition.size(slice));
+    for (PimRankID rank_id = 0; rank_id < m_spare_start_rank; ++rank_id)
+        index_rank(rank_id);
+}
+
+void DpuMapper::index_rank(PimRankID rank_id)
+{
+    const auto data_size = m_reference.seq.data_size();
+    size_t nb_dpu_in_rank = m_rankset.nb_dpu_in_rank(rank_id);
+    size_t rank_start = m_rankset.get_rank_start_dpu_id(rank_id);
+
+    // Transfers of a rank have one size, the one of its largest slice
+    size_t max_size = 0;
+    for (size_t i = 0; i < nb_dpu_in_rank; ++i)
+        max_size = std::max(max_size, m_partition.size(m_dpu_slice[rank_start + i]));
+    const size_t transfer_size = CEILN<8>((max_size >> 2) * sizeof(uint8_t));
+
+    // One program for the rank, that holds the seeds of its largest slice
+    uint64_t max_seeds = 0;
+    for (size_t i = 0; i < nb_dpu_in_rank; ++i)
+        max_seeds = std::max(max_seeds, m_slice_seeds[m_dpu_slice[rank_start + i]]);
+    auto config = m_options.index_config == AUTO_INDEX_CONFIG ? pick_index_config(max_seeds) : m_options.index_config;
+    if (config == AUTO_INDEX_CONFIG || INDEX_POS_CAPACITY(DPU_INDEX_CONFIGS[config].index_size2) < max_seeds)
+        exit(printf("No DPU index configuration holds the %lu seeds of a slice of rank %ld\n", max_seeds, rank_id));
+    m_rank_index_config[rank_id] = config;
+
+    std::vector<uint8_t *> buffers(nb_dpu_in_rank);
+    std::vector<IndexArgs *> args(nb_dpu_in_rank);
+    for (size_t i = 0; i < nb_dpu_in_rank; ++i)
+    {
+        auto dpu_id = rank_start + i;
+        auto slice = m_dpu_slice[dpu_id];
+        auto start_byte = m_partition.start_pos(slice) >> 2;
+        m_index_args[dpu_id].seq_size = m_partition.size(slice);
+        m_index_args[dpu_id].minimizer_window = m_options.minimizer_window;
+        args[i] = &m_index_args[dpu_id];
+        if (start_byte + transfer_size <= data_size)
+            buffers[i] = m_reference.seq.data(m_partition.start_pos(slice));
+        else
         {
-            buffers[dpu_id] = m_reference.seq.data(start_pos);
-            m_dpu_start_pos.push_back(start_pos);
-            start_pos = start_pos + m_dpu_ref_size - m_overlap; // Remains a multiple of 4
+            // Transfer would read past the end of the reference
+            auto &padded = m_padded_slices.emplace_back(transfer_size, 0);
+            memcpy(padded.data(), m_reference.seq.data() + start_byte, data_size - start_byte);
+            buffers[i] = padded.data();
         }
-        m_rankset.send_data_to_rank_async<uint8_t>(rank_id, "sequence", 0, buffers,
-                                                   CEILN<8>((m_dpu_ref_size >> 2) * sizeof(uint8_t)));
-        m_rankset.broadcast_to_rank_async(rank_id, "index_args", 0, &index_args, sizeof(index_args));
-        m_rankset.launch_rank_async(rank_id);
     }
+    m_rankset.lock_rank(rank_id);
+    m_rankset.load_binary(dpu_binary_path(config).c_str(), rank_id);
+    m_rankset.send_data_to_rank_async<uint8_t>(rank_id, "sequence", 0, buffers, transfer_size);
+    m_rankset.send_data_to_rank_async<IndexArgs>(rank_id, "index_args", 0, args, sizeof(IndexArgs));
+    m_rankset.launch_rank_async(rank_id);
+    m_rankset.unlock_rank(rank_id);
+}
+
+void DpuMapper::assign_hot_slices(const std::vector<uint64_t> &slice_loads)
+{
+    const auto first_spare = spare_start_dpu();
+    const auto nb_spares = static_cast<size_t>(m_rankset.nb_dpu()) - first_spare;
+    auto total = std::accumulate(slice_loads.begin(), slice_loads.end(), 0.0);
+    auto hottest = *std::max_element(slice_loads.begin(), slice_loads.end());
+    m_hot_slices_assigned = true;
+
+    // Every spare DPU takes a copy of the slice with the highest load per copy, the heaviest ones when none is hot
+    std::vector<size_t> nb_copies(m_nb_slices, m_replica_start_dpu.size());
+    using Entry = std::pair<double, uint32_t>;
+    std::priority_queue<Entry> heap;
+    for (uint32_t slice = 0; slice < m_nb_slices; ++slice)
+        heap.emplace(static_cast<double>(slice_loads[slice]) / static_cast<double>(nb_copies[slice]), slice);
+    m_slice_copies.assign(m_nb_slices, {});
+    for (size_t dpu_id = first_spare; dpu_id < first_spare + nb_spares; ++dpu_id)
+    {
+        auto slice = heap.top().second;
+        heap.pop();
+        m_dpu_slice[dpu_id] = slice;
+        m_dpu_start_pos[dpu_id] = m_partition.start_pos(slice);
+        m_slice_copies[slice].push_back(static_cast<uint32_t>(dpu_id));
+        heap.emplace(static_cast<double>(slice_loads[slice]) / static_cast<double>(++nb_copies[slice]), slice);
+    }
+
+    // Spare DPUs were never indexed: their queries are queued behind the index run of their rank
+    for (auto rank_id = m_spare_start_rank; rank_id < m_rankset.nb_ranks(); ++rank_id)
+        index_rank(rank_id);
+    auto nb_copied = std::count_if(m_slice_copies.begin(), m_slice_copies.end(), [](const auto &copies)
+                                   { return !copies.empty(); });
+    auto hottest_ratio = total > 0.0 ? static_cast<double>(hottest) * static_cast<double>(m_nb_slices) / total : 0.0;
+    printf("%s: %ld slices copied on %zu spare DPUs, hottest has %.1fx the mean load\n",
+           hottest_ratio >= HOT_SLICE_FACTOR ? "Hot slices" : "No hot slice, spare DPUs copy the heaviest slices", nb_copied,
+           nb_spares, hottest_ratio);
+}
+
+void DpuMapper::detect_hot_slices(const MappingWorkerData &mapping_data)
+{
+    std::vector<uint64_t> slice_loads(m_nb_slices, 0);
+    for (size_t dpu_id = 0; dpu_id < m_dpu_slice.size(); ++dpu_id)
+        slice_loads[m_dpu_slice[dpu_id]] += mapping_data.dpu_hits[dpu_id];
+    assign_hot_slices(slice_loads);
 }
 
 void DpuMapper::map(const std::string &queries_path, const std::string &output_path)
 {
     const std::array<ssize_t, 2> round_shift = {5, 15};
 
-    graal::BankFastaMMap<false> queries_bank(queries_path);
-    auto estimation = queries_bank.estimate();
-    // Retrieve query size (NB: we assume this is the same for all queries)
-    m_seed_search.range = adjust_seed_search_range(estimation.size_mean, round_shift, m_seed_search.range, m_seed_search.delta);
-    // check_read_size(estimation.size_min, estimation.size_max);
-    m_min_query_size = min_query_size(m_seed_search.range, m_seed_search.delta);
+    QueryReader queries_reader(queries_path);
+    ReadBatch reads;
+    if (!queries_reader.next(reads))
+        exit(printf("File: %s does not contain any query\n", queries_path.c_str()));
 
-    // Get estimated number of queries to reserve memory
-    size_t estimated_nb_queries = estimation.sequences_number;
+    // Retrieve query size from the first batch (NB: we assume this is the same for all queries)
+    size_t size_min = std::numeric_limits<size_t>::max(), size_max = 0, size_sum = 0;
+    for (size_t i = 0; i < reads.size(); ++i)
+    {
+        size_min = std::min<size_t>(size_min, reads.read_size(i));
+        size_max = std::max<size_t>(size_max, reads.read_size(i));
+        size_sum += reads.read_size(i);
+    }
+    auto size_mean = size_sum / reads.size();
+    m_seed_search.range = adjust_seed_search_range(size_mean, round_shift, m_seed_search.range, m_seed_search.delta);
+    // check_read_size(size_min, size_max);
+    m_min_query_size = min_query_size(m_seed_search.range, m_seed_search.delta);
 
     std::vector<Mapping> results;
 
-    printf("Estimation: the bank contains around %lu queries (%lu-(%lu)-%lu bp)\n", estimated_nb_queries,
-           estimation.size_min, estimation.size_mean, estimation.size_max);
+    printf("Estimation: the first batch contains %lu queries (%lu-(%lu)-%lu bp)\n", reads.size(), size_min, size_mean,
+           size_max);
 
-    auto it_begin = queries_bank.begin();
-    const auto it_end = queries_bank.end();
-
-    constexpr auto QUERIES_BATCH_SIZE = (1 << 17);
-    std::vector<Read> reads;
-    reads.reserve(QUERIES_BATCH_SIZE);
     size_t nb_dispatches_r1 = 0;
     BS::thread_pool_light result_thread_pool(2); // Two threads are enough, unlikely to have enough work to stall
 
-    MappingWorkerData worker_data(results, static_cast<size_t>(m_rankset.nb_ranks()), result_thread_pool, m_dpu_start_pos);
+    // Batches queued behind a running ring hold their buffer until the next launch of the rank
+    MappingWorkerData worker_data(results, static_cast<size_t>(m_rankset.nb_ranks()), result_thread_pool, m_dpu_start_pos,
+                                  (m_options.launch.overflow ? 3 : 2) + m_options.batch_ring - 1);
+    worker_data.dpu_hits.assign(static_cast<size_t>(m_rankset.nb_dpu()), 0);
+    m_batch_rings.clear();
+    if (m_options.batch_ring > 1)
+        for (PimRankID rank_id = 0; rank_id < m_rankset.nb_ranks(); ++rank_id)
+            m_batch_rings.push_back(std::make_unique<BatchRing>());
+
+    // With several passes, the encoded reads of the first pass are spooled for the next ones
+    std::unique_ptr<ReadSpool> spool;
+    if (m_options.nb_passes > 1)
+        spool = std::make_unique<ReadSpool>(output_path + ".spool");
+    std::vector<uint64_t> slice_hits(m_full_partition.nb_dpu(), 0);
+    uint64_t nb_verifications = 0;
 
-    ssize_t query_id = 0;
-    while (it_begin != it_end)
+    for (size_t pass = 0; pass < m_options.nb_passes; ++pass)
     {
-        const auto &query = reads.emplace_back(*it_begin, query_id);
-        if (query.seq.size() >= static_cast<size_t>(m_min_query_size))
+        if (pass > 0)
         {
-            nb_dispatches_r1 += dispatch_query(query, round_shift[0], worker_data);
+            load_pass(pass);
+            spool->rewind();
+            if (!spool->read(reads))
+                break;
         }
-        ++it_begin;
+        size_t nb_pass_dispatches = 0;
+
+        // In latency mode, ranks are launched on their deadline even while the dispatch waits for the next batch
+        std::atomic<bool> stop_timer{false};
+        std::thread deadline_timer;
+        if (m_options.launch.latency_mode)
+        {
+            worker_data.latency = std::make_unique<LatencyTracker>();
+            deadline_timer = std::thread([this, &worker_data, &stop_timer]()
+                                         {
+                const double period_ms = m_options.launch.max_age_ms / 4.0;
+                while (!stop_timer)
+                {
+                    std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(period_ms));
+                    launch_old_ranks(worker_data, period_ms); // Launch before the deadline passes until the next tick
+                } });
+        }
+
+        do
+        {
+            if (pass == 0)
+            {
+                // Results are indexed by query id, post-processing tasks hold the mutex while they access them
+                worker_data.mutex.lock();
+                results.resize(reads.id(reads.size() - 1) + 1, Mapping{std::numeric_limits<Mapping::distance_t>::max(), 0, 0, 0});
+                if (worker_data.latency)
+                    worker_data.latency->arrive(reads.id(0), reads.id(reads.size() - 1) + 1);
+                worker_data.mutex.unlock();
+                if (spool)
+                    spool->write(reads);
+            }
+
+            nb_pass_dispatches += dispatch_batch(reads, round_shift[0], worker_data);
+            if (m_options.spare_ranks > 0 && !m_hot_slices_assigned && m_hot_slice_hint.empty() &&
+                nb_pass_dispatches >= HOT_SLICE_MIN_DISPATCHES)
+                detect_hot_slices(worker_data);
+        } while (pass == 0 ? queries_reader.next(reads) : spool->read(reads));
+
+        if (deadline_timer.joinable())
+        {
+            stop_timer = true;
+            deadline_timer.join();
+        }
+        flush_ranks(worker_data);
+
+        // Speculative reads without a perfect first result fan out, until no more results are pending
+        while (m_options.speculative_dispatch)
+        {
+            wait_mapping_done(worker_data);
+            auto nb_retries = dispatch_retries(worker_data);
+            if (nb_retries == 0)
+                break;
+            nb_pass_dispatches += nb_retries;
+            flush_ranks(worker_data);
+        }
+        wait_mapping_done(worker_data);
+        m_padded_slices.clear();
+
+        // Hits of the pass go to its slices, the best mapping of each read is kept over the passes
+        for (size_t dpu_id = 0; dpu_id < m_dpu_slice.size(); ++dpu_id)
+            slice_hits[m_pass * m_nb_slices + m_dpu_slice[dpu_id]] += std::exchange(worker_data.dpu_hits[dpu_id], 0);
+        nb_dispatches_r1 += nb_pass_dispatches;
+        nb_verifications += count_verifications(); // Counters are reset with the program of the next pass
     }
+
+    auto nb_mapped = std::count_if(results.begin(), results.end(), [](const Mapping &mapping)
+                                   { return mapping.distance != std::numeric_limits<Mapping::distance_t>::max(); });
+    printf("DPU work: %zu (read, DPU) pairs, %.2f per mapped read\n", nb_dispatches_r1,
+           static_cast<double>(nb_dispatches_r1) / static_cast<double>(std::max<ssize_t>(nb_mapped, 1)));
+    printf("DPU verifications: %lu candidate positions, %.2f per read\n", nb_verifications,
+           static_cast<double>(nb_verifications) / static_cast<double>(std::max<size_t>(results.size(), 1)));
+    worker_data.fanout_stats.print();
+    if (!m_options.save_load_profile_path.empty())
+    {
+        // Replicas of a slice add up
+        LoadProfile profile{m_full_partition.start_positions(), {}, slice_hits};
+        for (size_t slice = 0; slice < m_full_partition.nb_dpu(); ++slice)
+            profile.sizes.push_back(m_full_partition.size(slice));
+        profile.save_to_file(m_options.save_load_profile_path);
+        printf("Load profile saved to %s\n", m_options.save_load_profile_path.c_str());
+    }
+    if (m_options.speculative_dispatch)
+        worker_data.speculation.print();
+    worker_data.launch_stats.print();
+    if (worker_data.latency)
+        worker_data.latency->print();
 }
 
-void DpuMapper::launch_mapping(PimRankID rank_id, std::vector<MapAllArgs> *args, MappingWorkerData *mapping_data)
+void DpuMapper::launch_mapping(PimRankID rank_id, RankArgs *args, MappingWorkerData *mapping_data)
 {
+    if (m_options.batch_ring > 1)
+    {
+        // A running ring starts the next one when it is done
+        auto &ring = *m_batch_rings[rank_id];
+        {
+            std::lock_guard<std::mutex> lock(ring.mutex);
+            ring.waiting.push_back(args);
+            if (ring.busy)
+                return;
+            ring.busy = true;
+        }
+        start_ring(rank_id, mapping_data);
+        return;
+    }
+
+    _mm_sfence(); // Query slots are written with non-temporal stores
     m_rankset.lock_rank(rank_id);
-    m_rankset.send_data_to_rank_async<MapAllArgs, MapArgs>(rank_id, "map_args", 0, *args, sizeof(MapArgs));
+    send_rank_args(rank_id, *args, 0);
     m_rankset.launch_rank_async(rank_id);
 
     m_rankset.add_callback_async(rank_id, [this, args, rank_id, mapping_data]()
@@ -241,4 +1264,83 @@ void DpuMapper::launch_mapping(PimRankID rank_id, std::vector<MapAllArgs> *args,
                                        m_rankset.get_data_from_rank_sync<MapResults>(rank_id, "map_results", 0, sizeof(MapResults)), args,
                                        m_rankset.get_rank_start_dpu_id(rank_id), mapping_data); });
     m_rankset.unlock_rank(rank_id);
-}
\ No newline at end of file
+}
+
+void DpuMapper::start_ring(PimRankID rank_id, MappingWorkerData *mapping_data)
+{
+    auto &ring = *m_batch_rings[rank_id];
+    std::vector<RankArgs *> batches;
+    {
+        std::lock_guard<std::mutex> lock(ring.mutex);
+        auto nb_batches = std::min(ring.waiting.size(), m_options.batch_ring);
+        batches.assign(ring.waiting.begin(), ring.waiting.begin() + static_cast<ssize_t>(nb_batches));
+        ring.waiting.erase(ring.waiting.begin(), ring.waiting.begin() + static_cast<ssize_t>(nb_batches));
+    }
+    ring.mailbox = {batches.size(), 0};
+
+    _mm_sfence(); // Query slots are written with non-temporal stores
+    m_rankset.lock_rank(rank_id);
+    for (size_t k = 0; k < batches.size(); ++k)
+        send_rank_args(rank_id, *batches[k], k);
+    m_rankset.broadcast_to_rank_async(rank_id, "mailbox", 0, &ring.mailbox, sizeof(MapMailbox));
+    m_rankset.launch_rank_async(rank_id);
+
+    m_rankset.add_callback_async(rank_id, [this, batches, rank_id, mapping_data]() mutable
+                                 {
+        for (const auto &mailbox : m_rankset.get_data_from_rank_sync<MapMailbox>(rank_id, "mailbox", 0, sizeof(MapMailbox)))
+            if (mailbox.completed != batches.size())
+                exit(printf("Rank %ld completed %lu of its %zu batches\n", rank_id, mailbox.completed, batches.size()));
+        std::vector<std::vector<MapResults>> results(batches.size());
+        for (size_t k = 0; k < batches.size(); ++k)
+            results[k] = m_rankset.get_data_from_rank_sync<MapResults>(rank_id, "map_results", static_cast<uint32_t>(k * sizeof(MapResults)),
+                                                                       sizeof(MapResults));
+        mapping_data->pool.push_task([this, rank_id, batches = std::move(batches), results = std::move(results), mapping_data]() mutable
+                                     { finish_ring(rank_id, batches, results, mapping_data); }); });
+    m_rankset.unlock_rank(rank_id);
+}
+
+void DpuMapper::finish_ring(PimRankID rank_id, std::vector<RankArgs *> &batches,
+                            std::vector<std::vector<MapResults>> &results, MappingWorkerData *mapping_data)
+{
+    // The rank starts its next ring before the host post-processes the results of this one
+    auto &ring = *m_batch_rings[rank_id];
+    bool restart = false;
+    {
+        std::lock_guard<std::mutex> lock(ring.mutex);
+        restart = !ring.waiting.empty();
+        ring.busy = restart;
+    }
+    if (restart)
+        start_ring(rank_id, mapping_data);
+
+    for (size_t k = 0; k < batches.size(); ++k)
+        post_process_mapping(std::move(results[k]), batches[k], m_rankset.get_rank_start_dpu_id(rank_id), mapping_data);
+}
+
+void DpuMapper::wait_mapping_done(MappingWorkerData &mapping_data)
+{
+    // Rings are started again from the post-processing tasks, until no batch is queued
+    bool busy = true;
+    while (busy)
+    {
+        m_rankset.wait_all_ranks_done();
+        mapping_data.pool.wait_for_tasks();
+        busy = false;
+        for (auto &ring : m_batch_rings)
+        {
+            std::lock_guard<std::mutex> lock(ring->mutex);
+            busy = busy || ring->busy;
+        }
+    }
+}
+
+void DpuMapper::send_rank_args(PimRankID rank_id, RankArgs &args, size_t batch)
+{
+    // Private slots are sent up to the fullest DPU, the shared region once to the whole rank
+    auto length = MAP_ARGS_HEADER_SIZE + args.max_private() * READ_SLOT_SIZE;
+    m_rankset.send_data_to_rank_async<MapAllArgs, MapArgs>(rank_id, "map_args", static_cast<uint32_t>(batch * sizeof(MapArgs)),
+                                                           args, length);
+    if (args.nb_shared > 0)
+        m_rankset.broadcast_to_rank_async(rank_id, "shared_queries", static_cast<uint32_t>(batch * sizeof(SharedQueries)),
+                                          args.shared.queries, args.nb_shared * READ_SLOT_SIZE);
+}
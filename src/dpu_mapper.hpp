@@ -1,33 +1,209 @@
 #ifndef DPUMAPPER_HPP
 #define DPUMAPPER_HPP
 
+#include <memory>
+#include <mutex>
+#include <span>
+
+#include "dpu_mapper_helper.hpp"
 #include "pim_rankset.hpp"
 #include "read.hpp"
+#include "read_batch.hpp"
 #include "read_mapper.hpp"
 
+enum class BloomRouting
+{
+    FLAT = 0,         // One filter, each row holds one bit per DPU (default)
+    HIERARCHICAL = 1, // Rank-level filter, then per-rank filters with one bit per DPU of the rank
+};
+
+/// @brief When a rank is launched. By default, as soon as one of its DPUs has MAX_NB_QUERIES_PER_DPU queries.
+struct LaunchPolicy
+{
+    double rank_fill{1.0};  // Launch when the rank holds this fraction of its capacity
+    double max_age_ms{0.0}; // Launch when the oldest staged query is older than this (0: no limit)
+    bool overflow{false};   // Full DPUs spill into a second buffer, the rank is launched when it is full too
+    // Latency mode: max_age_ms is a deadline enforced by a timer thread even when no read arrives, the fill threshold
+    // follows the arrival rate of each rank, and the read latencies are reported
+    bool latency_mode{false};
+};
+
+/// @brief Candidates kept when a read matches more DPUs than the fan-out cap
+enum class FanoutPolicy
+{
+    LEAST_LOADED = 0, // The DPUs with the fewest staged queries
+    ROUND_ROBIN = 1,  // A rotating window over the candidates, so that repeats spread over all their DPUs
+    REPEAT_PATH = 2,  // The read is set aside, then sent to its REPEAT_FANOUT_FACTOR * cap least loaded candidates
+};
+
+/// @brief Replica of the reference a read is sent to, when the reference is replicated over groups of ranks
+enum class ReplicaPolicy
+{
+    ROUND_ROBIN = 0,  // Each read goes to the next replica
+    LEAST_LOADED = 1, // Each read goes to the replica with the fewest staged queries
+};
+
+constexpr size_t REPEAT_FANOUT_FACTOR = 4;                 // Repeat path: a read set aside goes to this many times the cap
+constexpr size_t REPEAT_BUFFER_SIZE = DISPATCH_BLOCK_SIZE; // Repeat path: reads set aside before they are sent
+
+constexpr double HOT_SLICE_FACTOR = 4.0;              // A slice is reported hot when its load is this many times the mean
+constexpr size_t HOT_SLICE_MIN_DISPATCHES = 1UL << 16; // Dispatches counted before looking for hot slices
+
+struct DpuMapperOptions
+{
+    BloomRouting bloom_routing{BloomRouting::FLAT};
+    double hierarchical_fpr{HBF_TARGET_FPR}; // False positive DPUs per lookup the hierarchical filter is sized for
+    bool use_reference_cache{true};    // Map the encoded reference saved by the index app when it is up to date
+    bool write_reference_cache{false}; // Save the encoded reference after loading the FASTA file
+    LaunchPolicy launch{};
+    size_t batch_ring{1};             // Batches a rank maps in one launch, queued while it is busy (1: one per launch)
+    bool speculative_dispatch{false}; // Reads with several candidate DPUs go to the most likely one first
+    size_t max_fanout{0};             // Max DPUs a read is sent to (0: no cap)
+    FanoutPolicy fanout_policy{FanoutPolicy::LEAST_LOADED};
+    std::string load_profile_path;      // Per-DPU load of a previous run, to balance the slices of the reference
+    std::string save_load_profile_path; // Where to save the per-DPU load of this run
+    bool contig_packing{false};         // Slices hold whole contigs, only the contigs split between DPUs overlap
+    size_t spare_ranks{0};              // Last ranks kept out of the partition, they take copies of the hot slices
+    std::string hot_slices_path;        // Load profile giving the hot slices, else they are found from the first queries
+    size_t nb_passes{1};                // Passes over the queries, each one maps them on a part of the reference
+    size_t replica_ranks{0};            // Ranks holding one copy of the reference, replicated over the others (0: one copy)
+    ReplicaPolicy replica_policy{ReplicaPolicy::ROUND_ROBIN};
+    uint32_t minimizer_window{0};       // DPUs only index the minimizer of each window of this many seeds (0: all seeds)
+    size_t index_config{AUTO_INDEX_CONFIG}; // DPU program of every rank, in DPU_INDEX_CONFIGS
+    std::string index_stats_path;           // Where to save the index statistics of every DPU
+};
+
 class DpuMapper
 {
 public:
-    DpuMapper(const std::string &reference_path, ssize_t nb_ranks, bool create_bf);
+    DpuMapper(const std::string &reference_path, ssize_t nb_ranks, bool create_bf, const DpuMapperOptions &options = {});
 
     void map(const std::string &queries_path, const std::string &output_path);
 
 private:
+    /// @brief Slices saved with the filters, checked against the reference, unless create_bf: then load balanced or
+    /// contig packed slices if asked, else uniform ones, saved for the next runs. Sets create_bf when no saved
+    /// partition fits, the filters are then built for the new one.
+    ReferencePartition get_partition(const std::string &reference_path, const ContigRanges &contigs, bool &create_bf);
+    /// @brief Path the files of the filters of a pass are named after
+    std::string pass_reference_path(size_t pass) const;
+    /// @brief File of the filters of a pass
+    std::string pass_bloom_file_path(size_t pass) const;
+    /// @brief Slices and filters of a pass, built and saved if create_bf, else loaded
+    void load_pass_filters(size_t pass, bool create_bf, const ContigRanges &contigs);
+    /// @brief Index the slices of the current pass on the DPUs, with the hot slices given by the hint
+    void index_pass();
+    /// @brief Print the size, candidates per seed and collisions of the index of the DPUs, and save them per DPU if asked
+    void report_index(double seconds);
+    /// @brief Candidate positions the DPUs compared to queries since their index was built, over all ranks
+    uint64_t count_verifications();
+    /// @brief Load the DPU program again and index the slices of the pass
+    void load_pass(size_t pass);
+    /// @brief Split the ranks in groups of replica_ranks, each one holds all the slices of the reference
+    void initialize_replicas();
     void build_index();
-    size_t dispatch_query(const Read &query, ssize_t shift, MappingWorkerData &mapping_data);
-    void dispatch_query_to_dpu(size_t dpu_id, const Read &query, size_t start_pos, MappingWorkerData &mapping_data);
-    void launch_mapping(PimRankID rank_id, std::vector<MapAllArgs> *args, MappingWorkerData *mapping_data);
+    /// @brief Load the program that fits the slices of the DPUs of a rank, send the slices and launch their index
+    void index_rank(PimRankID rank_id);
+    size_t spare_start_dpu()
+    {
+        return m_spare_start_rank < m_rankset.nb_ranks() ? m_rankset.get_rank_start_dpu_id(m_spare_start_rank) : m_rankset.nb_dpu();
+    }
+    /// @brief Copy the slices with the highest load per copy on the spare DPUs and index them, once per pass. Slices
+    /// are reported hot when one has HOT_SLICE_FACTOR times the mean load, the spares take the heaviest ones anyway.
+    void assign_hot_slices(const std::vector<uint64_t> &slice_loads);
+    /// @brief Assign the hot slices from the queries dispatched so far
+    void detect_hot_slices(const MappingWorkerData &mapping_data);
+    /// @brief Send each candidate of bf_result to the least loaded copy of its slice
+    void spread_hot_slices(MappingWorkerData &mapping_data);
+    /// @brief Route a whole batch: seeds and Bloom lookups per block of reads, counting sort of the hits by DPU,
+    /// then one sequential fill of the query region of each DPU
+    /// @return number of (query, DPU) pairs dispatched
+    size_t dispatch_batch(const ReadBatch &reads, ssize_t shift, MappingWorkerData &mapping_data);
+    /// @brief Stage the queries of scratch.reads on the DPUs given by routes
+    /// @return number of (query, DPU) pairs staged
+    size_t route_block(const ReadBatch &reads, const BfBatchResult &routes, MappingWorkerData &mapping_data);
+    /// @brief Turn the candidate slices of each query in bf_result into the DPUs of one replica of the reference
+    void assign_replicas(MappingWorkerData &mapping_data);
+    /// @brief Keep at most max_fanout candidates of each query in scratch.capped, and record the fan-out histogram
+    void cap_fanout(const ReadBatch &reads, MappingWorkerData &mapping_data);
+    /// @brief Staged queries of every DPU in scratch.dpu_loads
+    void snapshot_dpu_loads(MappingWorkerData &mapping_data);
+    /// @brief Keep only the most likely candidate DPU of each query in scratch.routes, the others are kept pending
+    void speculate(const ReadBatch &reads, const BfBatchResult &candidates, MappingWorkerData &mapping_data);
+    /// @brief Index of the candidate whose filter holds most signatures of the read, the least loaded one on ties
+    size_t pick_candidate(const ReadView &query, std::span<const uint32_t> candidates, const std::vector<uint32_t> &loads);
+    /// @brief Send the speculative reads whose first result is not perfect to their other candidates
+    /// @return number of (query, DPU) pairs staged
+    size_t dispatch_retries(MappingWorkerData &mapping_data);
+    /// @brief Send the reads set aside by the repeat path to their REPEAT_FANOUT_FACTOR * max_fanout least loaded
+    /// candidates
+    size_t dispatch_repeats(MappingWorkerData &mapping_data);
+    void append_to_dpu(size_t dpu_id, std::span<const uint32_t> queries, const ReadBatch &reads, MappingWorkerData &mapping_data);
+    RankArgs *acquire_rank_buffer(PimRankID rank_id, MappingWorkerData &mapping_data);
+    RankArgs &get_rank_args(PimRankID rank_id, MappingWorkerData &mapping_data);
+    RankArgs &get_overflow_args(PimRankID rank_id, MappingWorkerData &mapping_data);
+
+    /// @brief Launch the main buffer of a rank, its overflow area becomes the main buffer
+    void launch_rank(PimRankID rank_id, LaunchTrigger trigger, MappingWorkerData &mapping_data);
+    /// @brief Launch the ranks whose oldest staged query is older than max_age_ms, or will be after margin_ms
+    void launch_old_ranks(MappingWorkerData &mapping_data, double margin_ms = 0.0);
+    /// @brief Queries to stage before a rank is launched
+    size_t launch_threshold(PimRankID rank_id, const RankStaging &staging);
+    void flush_ranks(MappingWorkerData &mapping_data);
+    /// @brief Queue the transfers of a rank buffer in slot batch of the ring of the rank, under the rank lock
+    void send_rank_args(PimRankID rank_id, RankArgs &args, size_t batch);
+    void launch_mapping(PimRankID rank_id, RankArgs *args, MappingWorkerData *mapping_data);
+    /// @brief Send up to batch_ring queued batches of a rank in the slots of its ring and launch it
+    void start_ring(PimRankID rank_id, MappingWorkerData *mapping_data);
+    /// @brief Start the next ring of a rank if batches are queued, then post-process the results of the last one
+    void finish_ring(PimRankID rank_id, std::vector<RankArgs *> &batches,
+                     std::vector<std::vector<MapResults>> &results, MappingWorkerData *mapping_data);
+    /// @brief Wait until the ranks are done and their results are post-processed, rings included
+    void wait_mapping_done(MappingWorkerData &mapping_data);
 
     CompactReference m_reference;
     PimRankSet<> m_rankset;
     ssize_t m_overlap{};
-    ssize_t m_dpu_ref_size{};
+    std::string m_reference_path;
+    // Pass p maps the queries on slices [p * m_nb_slices, (p + 1) * m_nb_slices) of m_full_partition, m_partition
+    // holds the slices of the current pass
+    ReferencePartition m_full_partition;
+    ReferencePartition m_partition;
+    size_t m_pass{};
     ssize_t m_min_query_size{};
     ssize_t m_max_query_size{};
-    IndexArgs index_args{};
+    std::vector<IndexArgs> m_index_args;
+    std::vector<std::vector<uint8_t>> m_padded_slices; // Copies of the last slices, alive until the index is built
     std::vector<size_t> m_dpu_start_pos;
+    std::vector<uint64_t> m_slice_seeds;      // Good seeds of each slice of the pass, bound of the positions of its index
+    std::vector<size_t> m_rank_index_config; // Program of each rank in DPU_INDEX_CONFIGS, AUTO_INDEX_CONFIG if not indexed
+
+    // Replicas of the reference: ranks [m_replica_start_rank[g], m_replica_start_rank[g + 1]) hold replica g, its
+    // DPU m_replica_start_dpu[g] + s holds slice s. DPUs past the slices of their replica hold another copy but get
+    // no query.
+    size_t m_nb_slices{};
+    std::vector<PimRankID> m_replica_start_rank;
+    std::vector<size_t> m_replica_start_dpu;
+    std::vector<uint32_t> m_dpu_slice;
+    // Ranks from m_spare_start_rank hold the copies of hot slices, m_slice_copies[s] are the spare DPUs holding slice s
+    PimRankID m_spare_start_rank{};
+    std::vector<std::vector<uint32_t>> m_slice_copies;
+    bool m_hot_slices_assigned{}; // Spare DPUs hold their copies for this pass, the loads are not scanned again
+    std::vector<uint64_t> m_hot_slice_hint; // Load of every slice of m_full_partition
+
+    // Batches launched while the ring of their rank was running wait for the next launch of the rank
+    struct BatchRing
+    {
+        std::mutex mutex;
+        std::vector<RankArgs *> waiting;
+        bool busy{false};
+        MapMailbox mailbox{}; // Sent asynchronously, must outlive the transfer
+    };
+    std::vector<std::unique_ptr<BatchRing>> m_batch_rings; // One per rank, only if batch_ring > 1
 
+    DpuMapperOptions m_options;
     MultiBloomFilter m_bloom_filters;
+    HierarchicalBloomFilter m_hierarchical_bloom_filters;
 
     struct
     {
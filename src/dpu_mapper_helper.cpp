@@ -30,22 +30,22 @@ ssize_t min_query_size(ssize_t range, ssize_t delta)
     return delta + range * 2 + static_cast<ssize_t>(HASH_SIZE);
 }
 
-ssize_t find_good_pos(const Read &query, ssize_t range, size_t shift)
+ssize_t find_good_pos(const ReadView &query, ssize_t range, size_t shift)
 {
     std::pair<size_t, size_t> result;
     ssize_t start_pos = static_cast<ssize_t>(shift);
     std::array<uint8_t, 4> bases{
-        query.seq[start_pos],
-        query.seq[start_pos + 1],
-        query.seq[start_pos + 2],
-        query.seq[start_pos + 3]};
+        query[start_pos],
+        query[start_pos + 1],
+        query[start_pos + 2],
+        query[start_pos + 3]};
     while (((start_pos - shift) <= static_cast<size_t>(range)) && !(is_good_seed(bases)))
     {
         start_pos++;
         bases[0] = bases[1];
         bases[1] = bases[2];
         bases[2] = bases[3];
-        bases[3] = query.seq[start_pos + 3];
+        bases[3] = query[start_pos + 3];
     }
     return start_pos;
 }
@@ -57,4 +57,79 @@ ssize_t get_round_shift(ssize_t shift, size_t read_size, ssize_t min_size)
         shift = std::max(shift - diff, 0L);
 
     return shift;
-}
\ No newline at end of file
+}
+/// @brief Good seeds starting at the 4 bases of the high byte of (byte << 8 | next byte)
+inline const std::array<uint8_t, 1 << 16> &good_seed_counts()
+{
+    static const auto counts = []()
+    {
+        std::array<uint8_t, 1 << 16> table{};
+        for (uint32_t bytes = 0; bytes < table.size(); ++bytes)
+        {
+            std::array<uint8_t, 8> bases{};
+            for (uint32_t i = 0; i < bases.size(); ++i)
+                bases[i] = (bytes >> (14 - 2 * i)) & 3;
+            for (uint32_t i = 0; i < 4; ++i)
+                table[bytes] += is_good_seed(bases, i) ? 1 : 0;
+        }
+        return table;
+    }();
+    return counts;
+}
+
+uint64_t count_good_seeds(const CompactSequence &seq, size_t start, size_t size)
+{
+    const auto &counts = good_seed_counts();
+    const auto *data = seq.data();
+    const auto data_size = seq.data_size();
+    uint64_t nb_seeds = 0;
+    for (size_t i = start >> 2; i < (start + size) >> 2; ++i)
+        nb_seeds += counts[(static_cast<uint32_t>(data[i]) << 8) | (i + 1 < data_size ? data[i + 1] : 0)];
+    return nb_seeds;
+}
+
+size_t pick_index_config(uint64_t nb_seeds)
+{
+    size_t smallest = AUTO_INDEX_CONFIG, largest = AUTO_INDEX_CONFIG;
+    for (size_t config = 0; config < NB_DPU_INDEX_CONFIGS; ++config)
+    {
+        const auto &c = DPU_INDEX_CONFIGS[config];
+        if (INDEX_POS_CAPACITY(c.index_size2) < nb_seeds)
+            continue;
+        auto better = [&c](size_t other, bool larger)
+        {
+            if (other == AUTO_INDEX_CONFIG)
+                return true;
+            const auto &o = DPU_INDEX_CONFIGS[other];
+            if (c.index_size2 != o.index_size2)
+                return larger == (c.index_size2 > o.index_size2);
+            return c.seed_size * 2 <= c.index_size2 && o.seed_size * 2 > o.index_size2;
+        };
+        if (static_cast<double>(nb_seeds) <= INDEX_TARGET_LOAD * static_cast<double>(1UL << c.index_size2) && better(smallest, false))
+            smallest = config;
+        if (better(largest, true))
+            largest = config;
+    }
+    return smallest != AUTO_INDEX_CONFIG ? smallest : largest;
+}
+
+size_t parse_index_config(const std::string &name)
+{
+    if (name == "auto")
+        return AUTO_INDEX_CONFIG;
+    for (size_t config = 0; config < NB_DPU_INDEX_CONFIGS; ++config)
+        if (name == index_config_name(config))
+            return config;
+    exit(printf("Unknown DPU index configuration %s\n", name.c_str()));
+}
+
+std::string index_config_name(size_t config)
+{
+    return std::to_string(DPU_INDEX_CONFIGS[config].index_size2) + ":" + std::to_string(DPU_INDEX_CONFIGS[config].seed_size);
+}
+
+std::string dpu_binary_path(size_t config)
+{
+    return "./dpu/short_read_mapping_" + std::to_string(DPU_INDEX_CONFIGS[config].index_size2) + "_" +
+           std::to_string(DPU_INDEX_CONFIGS[config].seed_size);
+}
@@ -3,12 +3,30 @@
 
 #include <array>
 #include <cstddef>
+#include <cstdint>
+#include <string>
 
-#include "read.hpp"
+#include "compact_sequence.hpp"
+#include "read_batch.hpp"
+
+constexpr size_t AUTO_INDEX_CONFIG = SIZE_MAX; // The host picks the DPU index configuration of each rank
+constexpr double INDEX_TARGET_LOAD = 1.0;      // Positions per cell of the count table, under which a larger table is useless
 
 ssize_t adjust_seed_search_range(size_t read_size, const std::array<ssize_t, 2> &round_shift, ssize_t range, ssize_t delta);
 ssize_t min_query_size(ssize_t range, ssize_t delta);
-ssize_t find_good_pos(const Read &query, ssize_t range, size_t shift);
+ssize_t find_good_pos(const ReadView &query, ssize_t range, size_t shift);
 ssize_t get_round_shift(ssize_t shift, size_t read_size, ssize_t min_size);
 
+/// @brief Good seeds starting in [start, start + size) of the sequence, start and size are multiples of 4
+uint64_t count_good_seeds(const CompactSequence &seq, size_t start, size_t size);
+/// @brief Configuration of DPU_INDEX_CONFIGS for a slice of nb_seeds good seeds: the smallest count table with at most
+/// INDEX_TARGET_LOAD positions per cell, else the largest one, unfolded seeds first. The position table must hold them.
+/// @return AUTO_INDEX_CONFIG if no configuration holds the seeds
+size_t pick_index_config(uint64_t nb_seeds);
+/// @brief Configuration named "<index_size2>:<seed_size>", or AUTO_INDEX_CONFIG for "auto"
+size_t parse_index_config(const std::string &name);
+std::string index_config_name(size_t config);
+/// @brief DPU program built with a configuration
+std::string dpu_binary_path(size_t config);
+
 #endif // DPU_MAPPER_HELPER_HPP#include <stddef.h>
@@ -6,14 +6,18 @@
 
 #include "read.hpp"
 
-#include "graal/Bank.hpp"
-
 constexpr std::string_view BLOOM_FILTER_EXTENSION = ".bf.bin";
+constexpr std::string_view HIERARCHICAL_BLOOM_FILTER_EXTENSION = ".hbf.bin";
+constexpr std::string_view REFERENCE_CACHE_EXTENSION = ".ref.bin";
+constexpr std::string_view PARTITION_EXTENSION = ".part.bin";
 
-Reference load_reference(graal::Bank &reference_bank, ssize_t nb_ranks);
-CompactReference load_and_compress_reference(graal::Bank &reference_bank, ssize_t nb_ranks);
+/// @brief Throw if a reference of ref_size bases cannot fit in the DPUs
+void check_reference_size(ssize_t ref_size, ssize_t nb_ranks);
 std::string validate_file(const std::string &reference_uri);
-std::string generate_bloom_file_path(const std::string &reference_uri, size_t nb_dpu, size_t hash_size);
+std::string generate_bloom_file_path(const std::string &reference_uri, size_t nb_dpu, size_t hash_size,
+                                     std::string_view extension = BLOOM_FILTER_EXTENSION);
+std::string generate_reference_cache_path(const std::string &reference_uri);
+std::string generate_partition_path(const std::string &reference_uri, size_t nb_dpu);
 bool check_bloom_file_exists(const std::string &bloom_file_path, bool force_create_bloom);
 
 #endif // FILE_UTILS_HPP
\ No newline at end of file
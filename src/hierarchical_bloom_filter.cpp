@@ -0,0 +1,163 @@
+#include <algorithm>
+
+#include "hierarchical_bloom_filter.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                      HierarchicalBloomFilter implem                        */
+/* -------------------------------------------------------------------------- */
+
+void HierarchicalBloomFilter::initialize(const std::vector<uint32_t> &rank_start_dpu_id, uint64_t rank_nb_rows,
+                                         const std::vector<uint64_t> &dpu_nb_rows)
+{
+    m_rank_start_dpu_id = rank_start_dpu_id;
+    m_nb_ranks = rank_start_dpu_id.size() - 1;
+    if (dpu_nb_rows.size() != m_nb_ranks)
+        exit(printf("Hierarchical bloom filter needs the rows of each of its %zu ranks\n", m_nb_ranks));
+    if (rank_nb_rows == 0 || rank_nb_rows > (1UL << 32) ||
+        std::any_of(dpu_nb_rows.begin(), dpu_nb_rows.end(), [](uint64_t rows)
+                    { return rows == 0 || rows > (1UL << 32); }))
+        exit(printf("Hierarchical bloom filter needs 1 to 2^32 rows per level\n"));
+
+    m_rank_sub_size = (m_nb_ranks + bf_pack_size - 1) >> bf_pack_size2;
+    m_rank_nb_rows = rank_nb_rows;
+    m_dpu_nb_rows = dpu_nb_rows;
+    m_rank_filter_offset.assign(1, m_rank_nb_rows * m_rank_sub_size);
+    for (auto rows : m_dpu_nb_rows)
+        m_rank_filter_offset.push_back(m_rank_filter_offset.back() + rows);
+
+    m_dpu_rank.clear();
+    for (size_t rank_id = 0; rank_id < m_nb_ranks; ++rank_id)
+    {
+        auto nb_dpu_in_rank = m_rank_start_dpu_id[rank_id + 1] - m_rank_start_dpu_id[rank_id];
+        if (nb_dpu_in_rank > bf_pack_size)
+            exit(printf("Hierarchical bloom filter supports at most %ld DPUs per rank\n", bf_pack_size));
+        m_dpu_rank.insert(m_dpu_rank.end(), nb_dpu_in_rank, static_cast<uint32_t>(rank_id));
+    }
+
+    m_data.clear();
+    m_data.resize(m_rank_filter_offset.back(), static_cast<pack_t>(0));
+}
+
+std::array<std::pair<uint64_t, uint64_t>, 2> HierarchicalBloomFilter::place_masks(const size_t dpu_id,
+                                                                                   const hash_t hash) const
+{
+    auto rank_id = m_dpu_rank[dpu_id];
+    auto i = dpu_id - m_rank_start_dpu_id[rank_id];
+    return {{{rank_row(hash) * m_rank_sub_size + (rank_id >> bf_pack_size2), 1UL << (rank_id & (bf_pack_size - 1))},
+             {m_rank_filter_offset[rank_id] + dpu_row(rank_id, hash), 1UL << i}}};
+}
+
+void HierarchicalBloomFilter::insert(const size_t dpu_id, const hash_t hash)
+{
+    for (const auto &[place, mask] : place_masks(dpu_id, hash))
+        m_data[place] |= mask;
+}
+
+bool HierarchicalBloomFilter::contains_one(const size_t dpu_id, const hash_t hash) const
+{
+    for (const auto &[place, mask] : place_masks(dpu_id, hash))
+        if ((m_data[place] & mask) == 0)
+            return false;
+    return true;
+}
+
+void HierarchicalBloomFilter::contains_batch(std::span<const std::pair<hash_t, hash_t>> signatures,
+                                             BfBatchResult &result) const
+{
+    auto n = signatures.size();
+    auto &candidates = result.candidates;
+    candidates.clear();
+    result.dpu_ids.clear();
+    result.offsets.resize(n + 1);
+
+    // First level: find candidate ranks of all queries, rank rows are prefetched ahead
+    auto rank_row_ptr = [this](hash_t h)
+    { return m_data.data() + rank_row(h) * m_rank_sub_size; };
+    for (size_t k = 0; k < std::min(n, m_PREFETCH_DISTANCE); ++k)
+    {
+        __builtin_prefetch(rank_row_ptr(signatures[k].first));
+        __builtin_prefetch(rank_row_ptr(signatures[k].second));
+    }
+    for (size_t k = 0; k < n; ++k)
+    {
+        if (k + m_PREFETCH_DISTANCE < n)
+        {
+            __builtin_prefetch(rank_row_ptr(signatures[k + m_PREFETCH_DISTANCE].first));
+            __builtin_prefetch(rank_row_ptr(signatures[k + m_PREFETCH_DISTANCE].second));
+        }
+        const auto *row1 = rank_row_ptr(signatures[k].first);
+        const auto *row2 = rank_row_ptr(signatures[k].second);
+        for (uint64_t i = 0; i < m_rank_sub_size; ++i)
+        {
+            for (auto val = row1[i] & row2[i]; val != 0; val &= val - 1)
+            {
+                auto rank_id = (i << bf_pack_size2) + static_cast<uint64_t>(__builtin_ctzll(val));
+                candidates.emplace_back(static_cast<uint32_t>(k), static_cast<uint32_t>(rank_id));
+            }
+        }
+    }
+
+    // Second level: one pack per row in the filter of each candidate rank
+    auto dpu_rows = [this, &signatures](const std::pair<uint32_t, uint32_t> &candidate)
+    {
+        const auto *filter = rank_filter(candidate.second);
+        const auto &[h1, h2] = signatures[candidate.first];
+        return std::make_pair(filter + dpu_row(candidate.second, h1), filter + dpu_row(candidate.second, h2));
+    };
+    for (size_t c = 0; c < std::min(candidates.size(), m_PREFETCH_DISTANCE); ++c)
+    {
+        auto [row1, row2] = dpu_rows(candidates[c]);
+        __builtin_prefetch(row1);
+        __builtin_prefetch(row2);
+    }
+    size_t next_query = 0;
+    for (size_t c = 0; c < candidates.size(); ++c)
+    {
+        if (c + m_PREFETCH_DISTANCE < candidates.size())
+        {
+            auto [row1, row2] = dpu_rows(candidates[c + m_PREFETCH_DISTANCE]);
+            __builtin_prefetch(row1);
+            __builtin_prefetch(row2);
+        }
+        for (; next_query <= candidates[c].first; ++next_query)
+            result.offsets[next_query] = static_cast<uint32_t>(result.dpu_ids.size());
+        auto [row1, row2] = dpu_rows(candidates[c]);
+        decode_pack(*row1 & *row2, m_rank_start_dpu_id[candidates[c].second], result.dpu_ids);
+    }
+    for (; next_query <= n; ++next_query)
+        result.offsets[next_query] = static_cast<uint32_t>(result.dpu_ids.size());
+}
+
+void HierarchicalBloomFilter::save_to_file(std::string file_path, uint32_t signature_scheme) const
+{
+    std::ofstream out(file_path, std::ios::binary);
+    write_bf_header(out, signature_scheme);
+    write_binary(MAGIC, out);
+    write_binary(m_nb_ranks, out);
+    write_binary(m_rank_nb_rows, out);
+    write_binary(m_dpu_nb_rows, out);
+    write_binary(m_rank_start_dpu_id, out);
+    write_binary(m_data, out);
+    out.close();
+}
+
+void HierarchicalBloomFilter::load_from_file(std::string file_path, uint32_t signature_scheme)
+{
+    std::ifstream in(file_path, std::ios::binary);
+    check_bf_header(in, signature_scheme, file_path);
+    uint64_t magic = 0;
+    read_binary(magic, in);
+    if (magic != MAGIC)
+        exit(printf("%s is not a hierarchical bloom filter of this version, build it again\n", file_path.c_str()));
+    size_t nb_ranks = 0;
+    uint64_t rank_nb_rows = 0;
+    read_binary(nb_ranks, in);
+    read_binary(rank_nb_rows, in);
+    std::vector<uint64_t> dpu_nb_rows(nb_ranks);
+    read_binary(dpu_nb_rows, in);
+    std::vector<uint32_t> rank_start_dpu_id(nb_ranks + 1);
+    read_binary(rank_start_dpu_id, in);
+    initialize(rank_start_dpu_id, rank_nb_rows, dpu_nb_rows);
+    read_binary(m_data, in);
+    in.close();
+}
@@ -0,0 +1,95 @@
+#ifndef HIERARCHICAL_BLOOM_FILTER_HPP
+#define HIERARCHICAL_BLOOM_FILTER_HPP
+
+#include <array>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "bloom_filter.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                          HierarchicalBloomFilter                           */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Two-level routing filter: a rank-level multi filter selects candidate ranks, then one multi filter per rank
+/// (one 64 bits pack per row, one bit per DPU of the rank) selects the DPUs inside them.
+/// Rows are mapped with a multiply-shift so their number does not need to be a power of 2, each per-rank filter has
+/// its own number of rows.
+class HierarchicalBloomFilter
+{
+public:
+    static constexpr uint64_t MAGIC = 0x3230'4642'4848'4d4d; // "MMHHBF02"
+
+    HierarchicalBloomFilter() {}
+
+    /// @brief Allocate the filters
+    /// @param rank_start_dpu_id id of the first DPU of each rank, followed by the total number of DPUs
+    /// @param rank_nb_rows number of rows of the rank-level filter
+    /// @param dpu_nb_rows number of rows of the filter of each rank
+    void initialize(const std::vector<uint32_t> &rank_start_dpu_id, uint64_t rank_nb_rows, const std::vector<uint64_t> &dpu_nb_rows);
+
+    /// @brief Compute where an item must be inserted, one place and mask per level
+    /// @param dpu_id global id of the DPU holding the item
+    /// @param hash hashed item to insert
+    std::array<std::pair<uint64_t, uint64_t>, 2> place_masks(const size_t dpu_id, const hash_t hash) const;
+    void insert(const size_t dpu_id, const hash_t hash);
+    /// @brief Check if one item may be held by one DPU, in both levels
+    bool contains_one(const size_t dpu_id, const hash_t hash) const;
+
+    /// @brief Look up a block of queries at once, each level is prefetched ahead
+    /// @param signatures pair of hashes for each query
+    /// @param result DPU ids matched by each query, in increasing order (buffers are reused between calls)
+    void contains_batch(std::span<const std::pair<hash_t, hash_t>> signatures, BfBatchResult &result) const;
+
+    /// @brief Save the data into a file
+    /// @param file_path path of the file
+    /// @param signature_scheme scheme used to compute the inserted hashes
+    void save_to_file(std::string file_path, uint32_t signature_scheme) const;
+
+    /// @brief Load from a file
+    /// @param file_path path of the file
+    /// @param signature_scheme scheme that will be used for lookups, must match the one of the file
+    void load_from_file(std::string file_path, uint32_t signature_scheme);
+
+    auto &data() { return m_data; }
+    const auto &data() const { return m_data; }
+    size_t memory_size() const { return m_data.size() * sizeof(pack_t); }
+    size_t nb_ranks() const { return m_nb_ranks; }
+    const auto &rank_start_dpu_id() const { return m_rank_start_dpu_id; }
+
+private:
+    uint64_t rank_row(const hash_t hash) const { return (static_cast<uint64_t>(hash) * m_rank_nb_rows) >> 32; }
+    uint64_t dpu_row(size_t rank_id, const hash_t hash) const
+    {
+        return (static_cast<uint64_t>(remix(hash)) * m_dpu_nb_rows[rank_id]) >> 32;
+    }
+    const pack_t *rank_filter(size_t rank_id) const { return m_data.data() + m_rank_filter_offset[rank_id]; }
+
+    /// @brief Second level must not use the same bits of the hash as the first one, or false positives correlate
+    static constexpr hash_t remix(hash_t h)
+    {
+        h ^= h >> 16;
+        h *= 0x85ebca6b;
+        h ^= h >> 13;
+        h *= 0xc2b2ae35;
+        h ^= h >> 16;
+        return h;
+    }
+
+    size_t m_nb_ranks{};
+    uint64_t m_rank_sub_size{}; // Packs per row of the rank-level filter
+    uint64_t m_rank_nb_rows{};
+    std::vector<uint64_t> m_dpu_nb_rows;
+    std::vector<uint64_t> m_rank_filter_offset; // Per-rank filters are stored after the rank-level filter
+
+    std::vector<uint32_t> m_rank_start_dpu_id;
+    std::vector<uint32_t> m_dpu_rank; // Rank of each DPU
+
+    std::vector<pack_t> m_data;
+
+    static constexpr size_t m_PREFETCH_DISTANCE = 16; // In number of rows pairs
+};
+
+#endif // HIERARCHICAL_BLOOM_FILTER_HPP
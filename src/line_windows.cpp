@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <omp.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "line_windows.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                             LineWindows implem                             */
+/* -------------------------------------------------------------------------- */
+
+constexpr uint8_t GZIP_ID1 = 0x1f;
+constexpr uint8_t GZIP_ID2 = 0x8b;
+constexpr uint8_t GZIP_FEXTRA = 0x04;
+constexpr size_t GZIP_HEADER_SIZE = 12; // Fixed part of the header, up to XLEN included
+constexpr size_t GZIP_TRAILER_SIZE = 8; // CRC32 + ISIZE
+
+inline uint16_t read_le16(const uint8_t *p) { return static_cast<uint16_t>(p[0] | (p[1] << 8)); }
+inline uint32_t read_le32(const uint8_t *p) { return read_le16(p) | (static_cast<uint32_t>(read_le16(p + 2)) << 16); }
+
+/// @brief Size of the BGZF block starting at p (BSIZE + 1), 0 if it is not a BGZF block
+size_t bgzf_block_size(const uint8_t *p, size_t available)
+{
+    if (available < GZIP_HEADER_SIZE + GZIP_TRAILER_SIZE || p[0] != GZIP_ID1 || p[1] != GZIP_ID2 ||
+        !(p[3] & GZIP_FEXTRA))
+        return 0;
+    size_t xlen = read_le16(p + 10);
+    for (size_t i = GZIP_HEADER_SIZE; i + 4 <= GZIP_HEADER_SIZE + xlen && i + 4 <= available;)
+    {
+        size_t slen = read_le16(p + i + 2);
+        if (p[i] == 'B' && p[i + 1] == 'C' && slen == 2 && i + 6 <= available)
+            return static_cast<size_t>(read_le16(p + i + 4)) + 1;
+        i += 4 + slen;
+    }
+    return 0;
+}
+
+LineWindows::LineWindows(const std::string &file_path, size_t window_size)
+    : m_file_path(file_path), m_window_size(window_size)
+{
+    int fd = open(file_path.c_str(), O_RDONLY);
+    struct stat st{};
+    if (fd < 0 || fstat(fd, &st) != 0)
+        exit(printf("Cannot open file: %s\n", file_path.c_str()));
+    m_file_size = static_cast<size_t>(st.st_size);
+
+    if (m_file_size > 0)
+    {
+        void *file = mmap(nullptr, m_file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (file == MAP_FAILED)
+            exit(printf("Cannot mmap file: %s\n", file_path.c_str()));
+        madvise(file, m_file_size, MADV_SEQUENTIAL);
+        m_file = static_cast<const char *>(file);
+    }
+    close(fd);
+
+    const auto *bytes = reinterpret_cast<const uint8_t *>(m_file);
+    if (m_file_size < 2 || bytes[0] != GZIP_ID1 || bytes[1] != GZIP_ID2)
+    {
+        m_format = Format::PLAIN;
+        m_estimated_size = m_file_size;
+        return;
+    }
+
+    if (bgzf_block_size(bytes, m_file_size) == 0)
+    {
+        // Regular gzip cannot be split, it is streamed from the file instead
+        m_format = Format::GZIP;
+        munmap(const_cast<char *>(m_file), m_file_size);
+        m_file = nullptr;
+        m_gz_file = gzopen(file_path.c_str(), "rb");
+        if (m_gz_file == nullptr)
+            exit(printf("Cannot open file: %s\n", file_path.c_str()));
+        gzbuffer(m_gz_file, 1 << 20);
+        return;
+    }
+
+    // BGZF: index all blocks from their headers, the inflated size of each one is in its trailer
+    m_format = Format::BGZF;
+    for (size_t offset = 0; offset < m_file_size;)
+    {
+        auto block_size = bgzf_block_size(bytes + offset, m_file_size - offset);
+        if (block_size == 0 || offset + block_size > m_file_size)
+            exit(printf("Malformed BGZF block at offset %zu of %s\n", offset, file_path.c_str()));
+        auto xlen = read_le16(bytes + offset + 10);
+        auto text_size = read_le32(bytes + offset + block_size - 4);
+        if (text_size > 0)
+        {
+            m_blocks.push_back({offset + GZIP_HEADER_SIZE + xlen,
+                                static_cast<uint32_t>(block_size - GZIP_HEADER_SIZE - xlen - GZIP_TRAILER_SIZE),
+                                text_size});
+            m_estimated_size += text_size;
+        }
+        offset += block_size;
+    }
+}
+
+LineWindows::~LineWindows()
+{
+    if (m_file != nullptr)
+        munmap(const_cast<char *>(m_file), m_file_size);
+    if (m_gz_file != nullptr)
+        gzclose(m_gz_file);
+}
+
+std::string_view LineWindows::next()
+{
+    if (m_format == Format::PLAIN)
+    {
+        if (m_position >= m_file_size)
+            return {};
+        auto start = m_position;
+        auto end = std::min(start + m_window_size, m_file_size);
+        if (end < m_file_size)
+        {
+            // Stop after the last line of the window, or after the first one if it is longer than the window
+            const auto *last = static_cast<const char *>(memrchr(m_file + start, '\n', end - start));
+            if (last == nullptr)
+                last = static_cast<const char *>(memchr(m_file + end, '\n', m_file_size - end));
+            end = last == nullptr ? m_file_size : static_cast<size_t>(last - m_file) + 1;
+        }
+        m_position = end;
+        return {m_file + start, end - start};
+    }
+
+    auto size = keep_carry();
+    while (!m_end_of_input)
+    {
+        auto previous_size = size;
+        size = m_format == Format::GZIP ? read_gzip(size) : inflate_blocks(size);
+        if (memchr(m_buffer.data() + previous_size, '\n', size - previous_size) != nullptr)
+            break;
+    }
+    return cut_window(size);
+}
+
+size_t LineWindows::keep_carry()
+{
+    auto carry = m_buffer_end - m_window_end;
+    if (carry > 0)
+        memmove(m_buffer.data(), m_buffer.data() + m_window_end, carry);
+    m_window_end = m_buffer_end = 0;
+    return carry;
+}
+
+size_t LineWindows::read_gzip(size_t size)
+{
+    if (m_buffer.size() < size + m_window_size)
+        m_buffer.resize(size + m_window_size);
+    auto nb_read = gzread(m_gz_file, m_buffer.data() + size, static_cast<unsigned>(m_window_size));
+    if (nb_read < 0)
+    {
+        int error = 0;
+        exit(printf("Cannot decompress %s\n", gzerror(m_gz_file, &error))); // zlib prefixes the message with the path
+    }
+    if (static_cast<size_t>(nb_read) < m_window_size)
+        m_end_of_input = true;
+    return size + static_cast<size_t>(nb_read);
+}
+
+size_t LineWindows::inflate_blocks(size_t size)
+{
+    // Take whole blocks up to one window of text
+    auto first_block = m_next_block;
+    std::vector<size_t> text_offsets{size};
+    while (m_next_block < m_blocks.size() &&
+           (m_next_block == first_block || text_offsets.back() - size + m_blocks[m_next_block].text_size <= m_window_size))
+        text_offsets.push_back(text_offsets.back() + m_blocks[m_next_block++].text_size);
+    m_end_of_input = m_next_block == m_blocks.size();
+    if (m_buffer.size() < text_offsets.back())
+        m_buffer.resize(text_offsets.back());
+
+    const auto nb_blocks = static_cast<ssize_t>(m_next_block - first_block);
+    ssize_t nb_failed = 0;
+#pragma omp parallel
+    {
+        z_stream stream{};
+        inflateInit2(&stream, -MAX_WBITS); // Raw deflate data, headers are already parsed
+#pragma omp for schedule(dynamic, 16) reduction(+ : nb_failed)
+        for (ssize_t i = 0; i < nb_blocks; ++i)
+        {
+            const auto &block = m_blocks[first_block + i];
+            inflateReset(&stream);
+            stream.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(m_file + block.offset));
+            stream.avail_in = block.size;
+            stream.next_out = reinterpret_cast<Bytef *>(m_buffer.data() + text_offsets[i]);
+            stream.avail_out = block.text_size;
+            if (inflate(&stream, Z_FINISH) != Z_STREAM_END || stream.total_out != block.text_size)
+                ++nb_failed;
+        }
+        inflateEnd(&stream);
+    }
+    if (nb_failed > 0)
+        exit(printf("Cannot decompress %s: %ld corrupted BGZF blocks\n", m_file_path.c_str(), nb_failed));
+
+    return text_offsets.back();
+}
+
+std::string_view LineWindows::cut_window(size_t size)
+{
+    m_buffer_end = m_window_end = size;
+    if (!m_end_of_input)
+    {
+        const auto *last = static_cast<const char *>(memrchr(m_buffer.data(), '\n', size));
+        m_window_end = last == nullptr ? size : static_cast<size_t>(last - m_buffer.data()) + 1;
+    }
+    return {m_buffer.data(), m_window_end};
+}
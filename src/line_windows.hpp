@@ -0,0 +1,81 @@
+#ifndef LINE_WINDOWS_HPP
+#define LINE_WINDOWS_HPP
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <zlib.h>
+
+/* -------------------------------------------------------------------------- */
+/*                                 LineWindows                                */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Reads a text file (FASTA, FASTQ) as successive windows of whole lines.
+/// Plain files are mmapped, BGZF files are inflated block by block on all cores, other gzip files are streamed
+/// with zlib on one core.
+class LineWindows
+{
+public:
+    /// @param file_path path of the file
+    /// @param window_size approximate size of the windows (a window holds at least one line)
+    explicit LineWindows(const std::string &file_path, size_t window_size = WINDOW_SIZE);
+    ~LineWindows();
+    LineWindows(const LineWindows &) = delete;
+    LineWindows &operator=(const LineWindows &) = delete;
+
+    /// @brief Next window, it starts at the beginning of a line and ends after a '\n' or at the end of the file
+    /// @return empty view at the end of the file, the previous window is invalidated
+    std::string_view next();
+
+    /// @brief Decompressed size of the file, 0 if it cannot be known before reading it
+    size_t estimated_size() const { return m_estimated_size; }
+
+    static constexpr size_t WINDOW_SIZE = 1UL << 28;
+
+private:
+    enum class Format
+    {
+        PLAIN,
+        GZIP,
+        BGZF,
+    };
+
+    struct BgzfBlock
+    {
+        size_t offset;      // Offset of the deflate data in the file
+        uint32_t size;      // Size of the deflate data
+        uint32_t text_size; // Size once inflated
+    };
+
+    /// @brief Move the incomplete last line of the previous window to the front of the buffer
+    size_t keep_carry();
+    /// @brief Read one window of text from the gzip stream after the first size bytes of the buffer
+    size_t read_gzip(size_t size);
+    /// @brief Inflate the next blocks, up to one window of text, after the first size bytes of the buffer, in parallel
+    size_t inflate_blocks(size_t size);
+    /// @brief Cut the buffer after its last complete line, keep the rest for the next window
+    std::string_view cut_window(size_t size);
+
+    std::string m_file_path; // For the error messages
+    size_t m_window_size;
+    Format m_format{Format::PLAIN};
+    size_t m_estimated_size{};
+
+    // Mmapped file (plain and BGZF)
+    const char *m_file{};
+    size_t m_file_size{};
+    size_t m_position{};
+
+    // Decompressed windows (gzip and BGZF)
+    gzFile m_gz_file{};
+    std::vector<BgzfBlock> m_blocks;
+    size_t m_next_block{};
+    std::vector<char> m_buffer;
+    size_t m_window_end{}; // End of the last window in m_buffer
+    size_t m_buffer_end{}; // End of the valid data in m_buffer
+    bool m_end_of_input{};
+};
+
+#endif // LINE_WINDOWS_HPP
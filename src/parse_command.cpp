@@ -7,10 +7,32 @@ cxxopts::ParseResult parse_mapper(int argc, char *argv[])
     cxxopts::Options options("Mapper", "Run Short Read Mapping on PIM");
 
     options.add_options()(
-        "r,reference", "URI to reference genome (e.g. 'file://genome.fa' or 'file://genome_album.txt')",
+        "r,reference", "Reference genome: FASTA file (plain, gzip or BGZF), or album listing one FASTA file per line",
         cxxopts::value<std::string>())("U,queries", "Path to queries file", cxxopts::value<std::string>())(
         "k,ranks", "Number of PIM ranks", cxxopts::value<ssize_t>()->default_value("4"))(
-        "s,sam", "Path of output in SAM format", cxxopts::value<bool>()->default_value("false"))("h,help", "Print usage");
+        "s,sam", "Path of output in SAM format", cxxopts::value<bool>()->default_value("false"))(
+        "hierarchical-bloom", "Route queries with a rank-level then per-rank bloom filter", cxxopts::value<bool>()->default_value("false"))(
+        "hierarchical-fpr", "False positive DPUs per lookup the hierarchical bloom filter is sized for, less memory when higher", cxxopts::value<double>()->default_value("0.0025"))(
+        "rebuild-bloom", "Build and save the partition and the bloom filters again, instead of loading the ones of the index app", cxxopts::value<bool>()->default_value("false"))(
+        "launch-fill", "Launch a rank once this fraction of its query slots is filled", cxxopts::value<double>()->default_value("1.0"))(
+        "launch-max-age", "Launch a rank when its oldest query waited this long in ms (0 disables)", cxxopts::value<double>()->default_value("0"))(
+        "launch-overflow", "Spill queries of a full DPU into a second buffer instead of launching its rank", cxxopts::value<bool>()->default_value("false"))(
+        "batch-ring", "Batches a rank maps in one launch, queued while the rank is busy (1 to 8)", cxxopts::value<size_t>()->default_value("1"))(
+        "latency-mode", "Enforce --launch-max-age as a deadline with a timer, adapt the fill threshold to the arrival rate and report read latencies", cxxopts::value<bool>()->default_value("false"))(
+        "speculative-dispatch", "Send reads to their most likely DPU first, and to their other candidates only if the result is not perfect", cxxopts::value<bool>()->default_value("false"))(
+        "max-fanout", "Max number of DPUs a read is sent to (0: no cap)", cxxopts::value<size_t>()->default_value("0"))(
+        "fanout-policy", "DPUs kept over the cap: least-loaded, round-robin, or repeat-path (set aside, then sent to 4x the cap)", cxxopts::value<std::string>()->default_value("least-loaded"))(
+        "load-profile", "Per-DPU load of a previous run, the reference slices are sized to balance it (rebuilds the bloom filters)", cxxopts::value<std::string>()->default_value(""))(
+        "save-load-profile", "Save the per-DPU load of this run, for --load-profile", cxxopts::value<std::string>()->default_value(""))(
+        "contig-packing", "Pack whole contigs in the reference slices, only split contigs overlap two DPUs", cxxopts::value<bool>()->default_value("false"))(
+        "replica-ranks", "Ranks holding one copy of the reference, replicated over the other ranks (0: one copy over all ranks)", cxxopts::value<size_t>()->default_value("0"))(
+        "replica-policy", "Replica a read is sent to: round-robin or least-loaded", cxxopts::value<std::string>()->default_value("round-robin"))(
+        "spare-ranks", "Last ranks kept out of the partition, to hold copies of the hot slices", cxxopts::value<size_t>()->default_value("0"))(
+        "hot-slices", "Load profile giving the hot slices for --spare-ranks, else found from the first queries", cxxopts::value<std::string>()->default_value(""))(
+        "passes", "Split the reference in this many parts, mapped one after the other on all the DPUs", cxxopts::value<size_t>()->default_value("1"))(
+        "minimizer-window", "DPUs only index the minimizer of each window of this many seeds, at most 16 (0: all seeds)", cxxopts::value<uint32_t>()->default_value("0"))(
+        "index-config", "DPU index as <table bits>:<seed bases> (20:10, 22:11, 22:13 or 23:12), or auto to fit the slices of each rank", cxxopts::value<std::string>()->default_value("auto"))(
+        "index-stats", "Save the positions, candidates per seed and collision rate of the index of every DPU (TSV)", cxxopts::value<std::string>()->default_value(""))("h,help", "Print usage");
 
     auto result = options.parse(argc, argv);
 
@@ -25,9 +47,19 @@ cxxopts::ParseResult parse_index(int argc, char *argv[])
     cxxopts::Options options("Index", "Index reference genome for PIM mapping");
 
     options.add_options()(
-        "r,reference", "URI to reference genome (e.g. 'file://genome.fa' or 'file://genome_album.txt')",
+        "r,reference", "Reference genome: FASTA file (plain, gzip or BGZF), or album listing one FASTA file per line",
         cxxopts::value<std::string>())(
-        "k,ranks", "Number of PIM ranks", cxxopts::value<ssize_t>()->default_value("4"))("h,help", "Print usage");
+        "k,ranks", "Number of PIM ranks", cxxopts::value<ssize_t>()->default_value("4"))(
+        "hierarchical-bloom", "Build a rank-level then per-rank bloom filter", cxxopts::value<bool>()->default_value("false"))(
+        "hierarchical-fpr", "False positive DPUs per lookup the hierarchical bloom filter is sized for, less memory when higher", cxxopts::value<double>()->default_value("0.0025"))(
+        "load-profile", "Per-DPU load saved by the mapper, the reference slices are sized to balance it", cxxopts::value<std::string>()->default_value(""))(
+        "contig-packing", "Pack whole contigs in the reference slices, only split contigs overlap two DPUs", cxxopts::value<bool>()->default_value("false"))(
+        "replica-ranks", "Ranks holding one copy of the reference, replicated over the other ranks (0: one copy over all ranks)", cxxopts::value<size_t>()->default_value("0"))(
+        "spare-ranks", "Last ranks kept out of the partition, as the mapper will run with --spare-ranks", cxxopts::value<size_t>()->default_value("0"))(
+        "passes", "Split the reference in this many parts, mapped one after the other on all the DPUs", cxxopts::value<size_t>()->default_value("1"))(
+        "minimizer-window", "DPUs only index the minimizer of each window of this many seeds, at most 16 (0: all seeds)", cxxopts::value<uint32_t>()->default_value("0"))(
+        "index-config", "DPU index as <table bits>:<seed bases> (20:10, 22:11, 22:13 or 23:12), or auto to fit the slices of each rank", cxxopts::value<std::string>()->default_value("auto"))(
+        "index-stats", "Save the positions, candidates per seed and collision rate of the index of every DPU (TSV)", cxxopts::value<std::string>()->default_value(""))("h,help", "Print usage");
 
     auto result = options.parse(argc, argv);
 
@@ -35,4 +67,22 @@ cxxopts::ParseResult parse_index(int argc, char *argv[])
         exit(printf("%s\n", options.help().c_str()));
 
     return result;
-}
\ No newline at end of file
+}
+cxxopts::ParseResult parse_bench(int argc, char *argv[])
+{
+    cxxopts::Options options("Bench", "Micro-benchmarks of the host side kernels");
+
+    options.add_options()(
+        "d,dpus", "Number of DPUs (filters) in the bloom filter", cxxopts::value<ssize_t>()->default_value("2560"))(
+        "b,bloom-size2", "Power of 2 of the number of rows in the bloom filter", cxxopts::value<ssize_t>()->default_value("24"))(
+        "n,lookups", "Number of lookups", cxxopts::value<size_t>()->default_value("4194304"))(
+        "i,inserts", "Number of items inserted per filter", cxxopts::value<size_t>()->default_value("16384"))(
+        "e,encode-size", "Number of bases to encode", cxxopts::value<size_t>()->default_value("268435456"))("h,help", "Print usage");
+
+    auto result = options.parse(argc, argv);
+
+    if (result.count("help") > 0)
+        exit(printf("%s\n", options.help().c_str()));
+
+    return result;
+}
@@ -1,4 +1,5 @@
 #include "cxxopts.hpp"
 
 cxxopts::ParseResult parse_mapper(int argc, char *argv[]);
-cxxopts::ParseResult parse_index(int argc, char *argv[]);
\ No newline at end of file
+cxxopts::ParseResult parse_index(int argc, char *argv[]);
+cxxopts::ParseResult parse_bench(int argc, char *argv[]);
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include <algorithm>
+#include <cstdio>
+#include <tuple>
+#include <type_traits>
+
+#include "binary_io.hpp"
+#include "partition.hpp"
+#include "pim_common.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                               utils functions                              */
+/* -------------------------------------------------------------------------- */
+
+ssize_t compute_dpu_reference_size(size_t reference_size, ssize_t nb_dpu, ssize_t overlap)
+{
+    ssize_t dpu_ref_size = static_cast<ssize_t>(reference_size);
+    dpu_ref_size = dpu_ref_size - ((nb_dpu + 1) * overlap);
+    dpu_ref_size = dpu_ref_size / nb_dpu + (2 * overlap);
+    dpu_ref_size = CEILN<4>(dpu_ref_size); // Align on 4 for the read packing
+    if (dpu_ref_size > static_cast<ssize_t>(MAX_DPU_REFERENCE_SIZE))
+        exit(printf("Reference sequence is too long, max %zu per DPU, current: %ld\n", MAX_DPU_REFERENCE_SIZE, dpu_ref_size));
+
+    return dpu_ref_size;
+}
+
+ContigRanges contig_ranges(const CompactReference &reference)
+{
+    // Reverse complements follow the forward strand in the same order, starting on a byte
+    ContigRanges contigs;
+    for (const auto &name : reference.names)
+        contigs.emplace_back(name.start_pos, name.size);
+    auto forward_size = reference.names.empty() ? 0 : reference.names.back().start_pos + reference.names.back().size;
+    auto reverse_start = CEILN<4>(forward_size);
+    for (const auto &name : reference.names)
+        contigs.emplace_back(reverse_start + name.start_pos, name.size);
+    return contigs;
+}
+
+/// @brief No header between the number of entries and the arrays
+struct NoHeader
+{
+};
+
+/// @brief Write the magic number, the number of entries, the header unless it is empty, then every array
+template <typename Header, typename... Arrays>
+void save_arrays(const std::string &file_path, uint64_t magic, const Header &header, const Arrays &...arrays)
+{
+    std::ofstream out(file_path, std::ios::binary);
+    uint64_t nb_entries = std::get<0>(std::tie(arrays...)).size();
+    write_binary(magic, out);
+    write_binary(nb_entries, out);
+    if constexpr (!std::is_empty_v<Header>)
+        write_binary(header, out);
+    (write_binary(arrays, out), ...);
+    if (!out)
+        exit(printf("Cannot write %s\n", file_path.c_str()));
+}
+
+template <typename Header, typename... Arrays>
+void load_arrays(const std::string &file_path, uint64_t magic, Header &header, Arrays &...arrays)
+{
+    std::ifstream in(file_path, std::ios::binary);
+    uint64_t file_magic = 0, nb_entries = 0;
+    read_binary(file_magic, in);
+    read_binary(nb_entries, in);
+    if (!in || file_magic != magic)
+        exit(printf("File %s is not a valid partition or load profile\n", file_path.c_str()));
+    if constexpr (!std::is_empty_v<Header>)
+        read_binary(header, in);
+    (arrays.resize(nb_entries), ...);
+    (read_binary(arrays, in), ...);
+    if (!in)
+        exit(printf("File %s is truncated\n", file_path.c_str()));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 LoadProfile                                */
+/* -------------------------------------------------------------------------- */
+
+void LoadProfile::save_to_file(const std::string &file_path) const
+{
+    save_arrays(file_path, MAGIC, NoHeader{}, start_pos, sizes, hits);
+}
+
+void LoadProfile::load_from_file(const std::string &file_path)
+{
+    NoHeader header{};
+    load_arrays(file_path, MAGIC, header, start_pos, sizes, hits);
+    if (!std::is_sorted(start_pos.begin(), start_pos.end()))
+        exit(printf("Load profile %s has unsorted slices\n", file_path.c_str()));
+}
+
+/* -------------------------------------------------------------------------- */
+/*                          ReferencePartition implem                         */
+/* -------------------------------------------------------------------------- */
+
+ReferencePartition ReferencePartition::uniform(size_t reference_size, size_t nb_dpu, size_t overlap)
+{
+    auto dpu_ref_size = static_cast<size_t>(
+        compute_dpu_reference_size(reference_size, static_cast<ssize_t>(nb_dpu), static_cast<ssize_t>(overlap)));
+    ReferencePartition partition{};
+    for (size_t dpu_id = 0; dpu_id < nb_dpu; ++dpu_id)
+    {
+        partition.m_start_pos.push_back(dpu_id * (dpu_ref_size - overlap)); // Remains a multiple of 4
+        partition.m_sizes.push_back(dpu_ref_size);
+    }
+    return partition;
+}
+
+ReferencePartition ReferencePartition::balanced(size_t reference_size, size_t nb_dpu, size_t overlap,
+                                                const LoadProfile &profile)
+{
+    // Regions of constant load density covering the reference: the profiled slices without their overlap
+    std::vector<uint64_t> bounds{0};
+    std::vector<double> loads;
+    double total_load = 0.0;
+    for (size_t j = 0; j < profile.start_pos.size(); ++j)
+    {
+        auto begin = std::min<uint64_t>(profile.start_pos[j], reference_size);
+        auto end = j + 1 < profile.start_pos.size() ? std::min<uint64_t>(profile.start_pos[j + 1], reference_size) : reference_size;
+        if (begin > bounds.back())
+        {
+            bounds.push_back(begin);
+            loads.push_back(0.0);
+        }
+        if (end > begin)
+        {
+            bounds.push_back(end);
+            loads.push_back(static_cast<double>(profile.hits[j]));
+            total_load += static_cast<double>(profile.hits[j]);
+        }
+    }
+    if (bounds.back() < reference_size)
+    {
+        bounds.push_back(reference_size);
+        loads.push_back(0.0);
+    }
+
+    // Cumulative cost at each bound, normalized to 1 at the end of the reference
+    const double size_weight = total_load > 0.0 ? PARTITION_SIZE_WEIGHT : 1.0;
+    std::vector<double> cum_cost{0.0};
+    for (size_t r = 0; r < loads.size(); ++r)
+    {
+        auto load_cost = total_load > 0.0 ? loads[r] / total_load : 0.0;
+        auto size_cost = static_cast<double>(bounds[r + 1] - bounds[r]) / static_cast<double>(reference_size);
+        cum_cost.push_back(cum_cost.back() + (1.0 - size_weight) * load_cost + size_weight * size_cost);
+    }
+    auto position_of_cost = [&bounds, &cum_cost](double cost)
+    {
+        auto r = static_cast<size_t>(std::upper_bound(cum_cost.begin(), cum_cost.end(), cost) - cum_cost.begin());
+        r = std::clamp<size_t>(r, 1, cum_cost.size() - 1) - 1;
+        auto fraction = (cost - cum_cost[r]) / (cum_cost[r + 1] - cum_cost[r]);
+        return bounds[r] + static_cast<uint64_t>(fraction * static_cast<double>(bounds[r + 1] - bounds[r]));
+    };
+
+    // Boundary k is where the cost reaches k / nb_dpu, as long as every slice stays in the size limits
+    const uint64_t max_step = FLOORN<4>(MAX_DPU_REFERENCE_SIZE - overlap);
+    const uint64_t min_step = CEILN<4>(std::max<size_t>(overlap, 4));
+    if (reference_size > nb_dpu * max_step)
+        exit(printf("Reference sequence is too long for %zu DPUs, current: %zu\n", nb_dpu, reference_size));
+
+    ReferencePartition partition{};
+    partition.m_start_pos.push_back(0);
+    for (size_t k = 1; k < nb_dpu; ++k)
+    {
+        auto previous = partition.m_start_pos.back();
+        auto remaining = nb_dpu - k;
+        auto start = FLOORN<4>(position_of_cost(static_cast<double>(k) / static_cast<double>(nb_dpu)));
+        start = std::min(start, previous + max_step);
+        if (reference_size > remaining * min_step)
+            start = std::min(start, FLOORN<4>(reference_size - remaining * min_step));
+        start = std::max(start, previous + min_step);
+        if (reference_size > remaining * max_step)
+            start = std::max(start, CEILN<4>(reference_size - remaining * max_step));
+        partition.m_start_pos.push_back(start);
+    }
+    for (size_t k = 0; k < nb_dpu; ++k)
+    {
+        auto end = k + 1 < nb_dpu ? partition.m_start_pos[k + 1] + overlap : reference_size;
+        partition.m_sizes.push_back(CEILN<4>(end - partition.m_start_pos[k]));
+    }
+    return partition;
+}
+
+/// @brief Pack contigs in slices of a given capacity
+/// @return false if more than max_slices are needed
+bool pack_contigs(size_t reference_size, size_t overlap, uint64_t capacity, size_t max_slices, const ContigRanges &contigs,
+                  std::vector<uint64_t> &starts, std::vector<uint64_t> &sizes)
+{
+    starts.clear();
+    sizes.clear();
+    uint64_t slice_start = 0;
+    auto close_slice = [&](uint64_t next_start, uint64_t end)
+    {
+        starts.push_back(slice_start);
+        sizes.push_back(CEILN<4>(end - slice_start));
+        slice_start = next_start;
+        return starts.size() < max_slices;
+    };
+    for (const auto &[start, size] : contigs)
+    {
+        const auto end = start + size;
+        while (end - slice_start > capacity)
+        {
+            bool fits = start > slice_start && size <= capacity;
+            if (fits && !close_slice(start, start)) // Whole contig goes to the next slice
+                return false;
+            if (fits)
+                continue;
+            // Contig is split, the part after the cut is also kept by this slice for the reads crossing it
+            auto cut = FLOORN<4>(slice_start + capacity - overlap);
+            if (!close_slice(cut, cut + overlap))
+                return false;
+        }
+    }
+    close_slice(reference_size, reference_size);
+    return true;
+}
+
+ReferencePartition ReferencePartition::contig_packed(size_t reference_size, size_t nb_dpu, size_t overlap, const ContigRanges &contigs)
+{
+    // Smallest capacity that fits in the DPUs
+    std::vector<uint64_t> starts, sizes;
+    uint64_t low = std::max<uint64_t>(CEILN<4>((reference_size + nb_dpu - 1) / nb_dpu), CEILN<4>(4 * overlap));
+    uint64_t high = FLOORN<4>(MAX_DPU_REFERENCE_SIZE);
+    if (!pack_contigs(reference_size, overlap, high, nb_dpu, contigs, starts, sizes))
+        exit(printf("Reference sequence is too long for %zu DPUs, current: %zu\n", nb_dpu, reference_size));
+    while (low < high)
+    {
+        auto capacity = FLOORN<4>(low + (high - low) / 2);
+        if (pack_contigs(reference_size, overlap, capacity, nb_dpu, contigs, starts, sizes))
+            high = capacity;
+        else
+            low = capacity + 4;
+    }
+    pack_contigs(reference_size, overlap, high, nb_dpu, contigs, starts, sizes);
+
+    // DPUs left over take half of the largest slices, cut between two contigs when one is close to the middle
+    std::vector<uint64_t> contig_starts;
+    for (const auto &contig : contigs)
+        contig_starts.push_back(contig.first);
+    while (starts.size() < nb_dpu)
+    {
+        auto i = static_cast<size_t>(std::max_element(sizes.begin(), sizes.end()) - sizes.begin());
+        auto start = starts[i], size = sizes[i];
+        auto middle = FLOORN<4>(start + size / 2);
+        auto boundary = std::lower_bound(contig_starts.begin(), contig_starts.end(), middle);
+        uint64_t first_size = 0;
+        if (boundary != contig_starts.end() && *boundary < start + 3 * size / 4)
+            middle = *boundary, first_size = middle - start;
+        else if (boundary != contig_starts.begin() && *(boundary - 1) > start + size / 4)
+            middle = *(boundary - 1), first_size = middle - start;
+        else
+            first_size = middle + overlap - start;
+        starts.insert(starts.begin() + static_cast<ssize_t>(i) + 1, middle);
+        sizes.insert(sizes.begin() + static_cast<ssize_t>(i) + 1, start + size - middle);
+        sizes[i] = CEILN<4>(first_size);
+    }
+
+    ReferencePartition partition{};
+    partition.m_start_pos = std::move(starts);
+    partition.m_sizes = std::move(sizes);
+    return partition;
+}
+
+ReferencePartition ReferencePartition::subset(size_t first, size_t count) const
+{
+    ReferencePartition partition{};
+    partition.m_start_pos.assign(m_start_pos.begin() + static_cast<ssize_t>(first), m_start_pos.begin() + static_cast<ssize_t>(first + count));
+    partition.m_sizes.assign(m_sizes.begin() + static_cast<ssize_t>(first), m_sizes.begin() + static_cast<ssize_t>(first + count));
+    return partition;
+}
+
+size_t ReferencePartition::max_size() const
+{
+    return m_sizes.empty() ? 0 : *std::max_element(m_sizes.begin(), m_sizes.end());
+}
+
+size_t ReferencePartition::min_size() const
+{
+    return m_sizes.empty() ? 0 : *std::min_element(m_sizes.begin(), m_sizes.end());
+}
+
+bool ReferencePartition::built_from(const ReferenceFingerprint &source, size_t reference_size) const
+{
+    return m_source.fingerprint == source && m_source.reference_size == reference_size;
+}
+
+void ReferencePartition::save_to_file(const std::string &file_path, const ReferenceFingerprint &source,
+                                      size_t reference_size)
+{
+    m_source = {source, reference_size};
+    save_arrays(file_path, MAGIC, m_source, m_start_pos, m_sizes);
+}
+
+void ReferencePartition::load_from_file(const std::string &file_path)
+{
+    load_arrays(file_path, MAGIC, m_source, m_start_pos, m_sizes);
+}
@@ -0,0 +1,90 @@
+#ifndef PARTITION_HPP
+#define PARTITION_HPP
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "read.hpp"
+#include "reference_cache.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                             Reference partition                            */
+/* -------------------------------------------------------------------------- */
+
+constexpr size_t MAX_DPU_REFERENCE_SIZE = 24'000'000; // Bases one DPU can index
+constexpr double PARTITION_SIZE_WEIGHT = 0.1;         // Share of the cost of a slice that follows its size, not its load
+
+/// @brief Size of the slices of the uniform partition
+ssize_t compute_dpu_reference_size(size_t reference_size, ssize_t nb_dpu, ssize_t overlap);
+
+/// @brief Start and size of contigs, sorted by start
+using ContigRanges = std::vector<std::pair<uint64_t, uint64_t>>;
+
+/// @brief Every sequence of both strands, in the order of the reference
+ContigRanges contig_ranges(const CompactReference &reference);
+
+/// @brief Queries sent to every DPU by a previous run, with the slices the DPUs held
+struct LoadProfile
+{
+    static constexpr uint64_t MAGIC = 0x3130'4441'4f4c'4d4d; // "MMLOAD01"
+    std::vector<uint64_t> start_pos;
+    std::vector<uint64_t> sizes;
+    std::vector<uint64_t> hits;
+
+    void save_to_file(const std::string &file_path) const;
+    void load_from_file(const std::string &file_path);
+};
+
+/// @brief Slices of the reference held by the DPUs: DPU i holds [start_pos(i), start_pos(i) + size(i)). Consecutive
+/// slices overlap so that a read crossing a boundary is held by one of them. Starts and sizes are multiples of 4.
+class ReferencePartition
+{
+public:
+    static constexpr uint64_t MAGIC = 0x3230'5452'4150'4d4d; // "MMPART02"
+
+    /// @brief Slices of the same size, where DPU i starts at i * (size - overlap)
+    static ReferencePartition uniform(size_t reference_size, size_t nb_dpu, size_t overlap);
+
+    /// @brief Slices with the same expected cost. The load profile gives the density of queries along the reference
+    /// (uniform inside each profiled slice), and PARTITION_SIZE_WEIGHT of the cost follows the size so that cold
+    /// regions still spread over several DPUs. Slices stay under MAX_DPU_REFERENCE_SIZE.
+    static ReferencePartition balanced(size_t reference_size, size_t nb_dpu, size_t overlap, const LoadProfile &profile);
+
+    /// @brief Slices made of whole contigs, packed in the order of the reference with the smallest capacity that fits
+    /// the DPUs. A slice only overlaps the next one when a contig does not fit in a slice and is split. Contigs are not
+    /// padded in a slice: the DPUs index the seeds across their junctions, only the filters leave them out.
+    static ReferencePartition contig_packed(size_t reference_size, size_t nb_dpu, size_t overlap, const ContigRanges &contigs);
+
+    /// @brief Slices [first, first + count) of this partition
+    ReferencePartition subset(size_t first, size_t count) const;
+
+    size_t nb_dpu() const { return m_start_pos.size(); }
+    size_t start_pos(size_t dpu_id) const { return m_start_pos[dpu_id]; }
+    size_t size(size_t dpu_id) const { return m_sizes[dpu_id]; }
+    size_t max_size() const;
+    size_t min_size() const;
+    const std::vector<uint64_t> &start_positions() const { return m_start_pos; }
+
+    /// @brief Whether the partition was saved for this reference
+    bool built_from(const ReferenceFingerprint &source, size_t reference_size) const;
+
+    /// @brief Save the partition with the reference it was built for
+    void save_to_file(const std::string &file_path, const ReferenceFingerprint &source, size_t reference_size);
+    void load_from_file(const std::string &file_path);
+
+private:
+    /// @brief Reference a saved partition was built for
+    struct Source
+    {
+        ReferenceFingerprint fingerprint{};
+        uint64_t reference_size{}; // Both strands, as CompactSequence::size()
+    };
+
+    Source m_source{};
+    std::vector<uint64_t> m_start_pos;
+    std::vector<uint64_t> m_sizes;
+};
+
+#endif // PARTITION_HPP
@@ -81,26 +81,81 @@ static_assert(MAX_QUERY_SIZE <= 256,
 constexpr uint32_t MAX_NB_ERRORS = 4;
 static_assert(MAX_NB_ERRORS <= 8, "Not supporting to find more than 8 errors during the mapping");
 
+constexpr uint32_t MAX_MINIMIZER_WINDOW = 16; // Seeds in a window of the minimizer index
+constexpr uint32_t POS_BITS = 25;			   // Bits of a position in the index of a DPU
+
+/* ------------------------ DPU index configurations ------------------------ */
+
+constexpr uint64_t DPU_INDEX_MRAM = 48 << 20; // MRAM shared by the count and position tables of a DPU
+
+/// @brief Cells of the count table (power of 2) and bases of the seeds of one build of the DPU program
+struct DpuIndexConfig
+{
+	uint32_t index_size2;
+	uint32_t seed_size;
+};
+
+// Each configuration is built by dpu/Makefile, keep both lists in sync
+constexpr DpuIndexConfig DPU_INDEX_CONFIGS[] = {
+	{20, 10}, //  4 MB count table, 44 MB of positions
+	{22, 11}, // 16 MB count table, 32 MB of positions
+	{22, 13}, // 16 MB count table, 32 MB of positions, seeds folded on the table
+	{23, 12}, // 32 MB count table, 16 MB of positions, seeds folded on the table
+};
+constexpr size_t NB_DPU_INDEX_CONFIGS = sizeof(DPU_INDEX_CONFIGS) / sizeof(DpuIndexConfig);
+
+/// @brief Positions held by the position table next to a count table of 2^index_size2 cells
+constexpr uint64_t INDEX_POS_CAPACITY(uint32_t index_size2)
+{
+	return ((DPU_INDEX_MRAM - (sizeof(uint32_t) << index_size2)) * 8) / POS_BITS;
+}
+
 /* ------------------------- Communication utilities ------------------------ */
 
 struct IndexArgs
 {
 	uint64_t seq_size;
+	uint32_t minimizer_window; // Only the minimizer of each window of this many seeds is indexed (0 or 1: all seeds)
+	uint32_t unused;		   // Unused field, only there to align size on multiple of 8
+};
+
+struct IndexStats
+{
+	uint64_t nb_positions;	  // Positions in the index
+	uint64_t nb_cells;		  // Cells of the count table holding positions
+	uint64_t sum_squared_cnt; // Sum of the squared counts of the cells, a seed of the slice finds sum / nb_positions candidates
+	uint64_t nb_sampled;	  // Positions of the cells sampled for collisions
+	uint64_t nb_collisions;	  // Positions of the sampled cells whose seed is not the one of the first position of the cell
 };
 
+constexpr uint32_t MAX_SHARED_QUERIES_PER_RANK = 2048; // Queries broadcast to all the DPUs of a rank, 128 KB
+
+/// @brief Queries of the DPU in slots [0, MAX_NB_QUERIES_PER_DPU) of queries, and queries shared with other DPUs of
+/// its rank in slots [MAX_NB_QUERIES_PER_DPU, MAX_NB_QUERIES_PER_DPU + MAX_SHARED_QUERIES_PER_RANK) of SharedQueries.
+/// Queries come last so that only the slots in use are sent.
 struct MapArgs
 {
-	uint8_t queries[MAX_NB_QUERIES_PER_DPU * (MAX_QUERY_SIZE >> 2)];
-	uint32_t seed_positions[MAX_NB_QUERIES_PER_DPU];
-	uint8_t query_sizes[MAX_NB_QUERIES_PER_DPU];
 	uint32_t nb_queries{};
 	uint32_t unused{}; // Unused field, only there to align size on multiple of 8
+	uint32_t seed_positions[MAX_NB_QUERIES_PER_DPU];
+	uint16_t query_slots[MAX_NB_QUERIES_PER_DPU];
+	uint8_t query_sizes[MAX_NB_QUERIES_PER_DPU];
+	uint8_t queries[MAX_NB_QUERIES_PER_DPU * (MAX_QUERY_SIZE >> 2)];
+};
+constexpr uint32_t MAP_ARGS_HEADER_SIZE = sizeof(MapArgs) - sizeof(MapArgs::queries);
+static_assert((MAP_ARGS_HEADER_SIZE & 7) == 0, "Queries of MapArgs must be aligned on 8 bytes (DPU transfers restrictions)");
+static_assert(MAX_NB_QUERIES_PER_DPU + MAX_SHARED_QUERIES_PER_RANK <= UINT16_MAX, "Query slots must fit in 16 bits");
+
+struct SharedQueries
+{
+	uint8_t queries[MAX_SHARED_QUERIES_PER_RANK * (MAX_QUERY_SIZE >> 2)];
 };
 
 struct MapIdentifiers
 {
 	uint64_t data[MAX_NB_QUERIES_PER_DPU];
 	uint8_t read_sizes[MAX_NB_QUERIES_PER_DPU];
+	uint8_t speculative[MAX_NB_QUERIES_PER_DPU]; // Query sent to one candidate DPU only, the others wait for its result
 };
 
 struct MapAllArgs
@@ -108,6 +163,7 @@ struct MapAllArgs
 	MapAllArgs() : dpu_args() { dpu_args.nb_queries = 0; }
 	MapArgs dpu_args{};
 	MapIdentifiers identifiers{};
+	uint32_t nb_private{}; // Slots of dpu_args.queries in use
 };
 
 constexpr uint64_t ENCODE_MAP_RESULT(uint32_t distance, uint32_t position)
@@ -124,6 +180,15 @@ struct MapResults
 	uint64_t error_positions[MAX_NB_QUERIES_PER_DPU];
 };
 
+constexpr uint32_t MAX_BATCH_RING = 8; // Batches a DPU can map in one launch
+
+/// @brief Batches written by the host in the ring of the DPU before a launch, and mapped by the DPU during it
+struct MapMailbox
+{
+	uint64_t doorbell;	// Batches of the ring to map, map_args[0, doorbell)
+	uint64_t completed; // Batches mapped so far, their results are in map_results
+};
+
 /* -------------------------- Good seed definition -------------------------- */
 
 template <typename T>
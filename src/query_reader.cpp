@@ -0,0 +1,207 @@
+#include <array>
+#include <cstdio>
+#include <cstring>
+
+#include "query_reader.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                             QueryReader implem                             */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Start of the line after the one starting at line, nullptr if the line does not end before end
+inline const char *next_line(const char *line, const char *end)
+{
+    const auto *nl = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(end - line)));
+    return nl == nullptr ? nullptr : nl + 1;
+}
+
+/// @brief Size of a line without its line break
+inline size_t line_size(const char *line, const char *line_end)
+{
+    auto size = static_cast<size_t>(line_end - line);
+    while (size > 0 && (line[size - 1] == '\n' || line[size - 1] == '\r'))
+        --size;
+    return size;
+}
+
+QueryReader::QueryReader(const std::string &file_path, size_t batch_size)
+    : m_windows(file_path, QUERY_WINDOW_SIZE), m_batch_size(batch_size)
+{
+    m_batch.reserve(m_batch_size);
+    m_reader_thread = std::thread(&QueryReader::read_text, this);
+    m_parser_thread = std::thread(&QueryReader::parse_text, this);
+}
+
+QueryReader::~QueryReader()
+{
+    m_stop = true;
+    m_text_blocks.close();
+    m_free_text_blocks.close();
+    m_batches.close();
+    m_free_batches.close();
+    m_reader_thread.join();
+    m_parser_thread.join();
+}
+
+bool QueryReader::next(ReadBatch &batch)
+{
+    if (batch.capacity() > 0)
+        m_free_batches.push(std::move(batch));
+    batch.clear();
+    return m_batches.pop(batch);
+}
+
+void QueryReader::read_text()
+{
+    for (auto window = m_windows.next(); !window.empty() && !m_stop; window = m_windows.next())
+    {
+        std::string block;
+        m_free_text_blocks.try_pop(block);
+        block.assign(window);
+        if (!m_text_blocks.push(std::move(block)))
+            return;
+    }
+    m_text_blocks.close();
+}
+
+void QueryReader::parse_text()
+{
+    std::string pending; // Incomplete last record of the previous block, followed by the current one
+    std::string block;
+    while (m_text_blocks.pop(block) && !m_stop)
+    {
+        if (pending.empty())
+        {
+            auto parsed = parse_records(block, false);
+            pending.assign(block, parsed);
+        }
+        else
+        {
+            pending.append(block);
+            pending.erase(0, parse_records(pending, false));
+        }
+        m_free_text_blocks.push(std::move(block));
+    }
+    if (m_stop)
+        return;
+
+    parse_records(pending, true);
+    if (!m_batch.empty())
+        push_batch();
+    m_batches.close();
+}
+
+size_t QueryReader::parse_records(std::string_view text, bool end_of_file)
+{
+    if (m_format == Format::UNKNOWN)
+    {
+        auto first = text.find_first_not_of(" \t\r\n");
+        if (first == std::string_view::npos)
+            return end_of_file ? text.size() : 0;
+        if (text[first] == '>')
+            m_format = Format::FASTA;
+        else if (text[first] == '@')
+            m_format = Format::FASTQ;
+        else
+            exit(printf("Queries file is neither FASTA nor FASTQ (starts with '%c')\n", text[first]));
+    }
+    return m_format == Format::FASTA ? parse_fasta(text, end_of_file) : parse_fastq(text, end_of_file);
+}
+
+size_t QueryReader::parse_fasta(std::string_view text, bool end_of_file)
+{
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    const char *record = begin;
+    while (record < end)
+    {
+        if (*record == '\n' || *record == '\r')
+        {
+            ++record;
+            continue;
+        }
+        if (*record != '>')
+            exit(printf("Malformed FASTA query after read %zu\n", m_next_id));
+
+        // A record ends at the next header, or at the end of the file
+        m_bases.clear();
+        const char *line = next_line(record, end);
+        while (line != nullptr && line < end && *line != '>')
+        {
+            const char *line_end = next_line(line, end);
+            if (line_end == nullptr && !end_of_file)
+                return static_cast<size_t>(record - begin);
+            line_end = line_end == nullptr ? end : line_end;
+            m_bases.append(line, line_size(line, line_end));
+            line = line_end;
+        }
+        if ((line == nullptr || line == end) && !end_of_file)
+            return static_cast<size_t>(record - begin);
+
+        add_read(m_bases.data(), m_bases.size());
+        if (m_stop)
+            return text.size();
+        record = line == nullptr ? end : line;
+    }
+    return text.size();
+}
+
+size_t QueryReader::parse_fastq(std::string_view text, bool end_of_file)
+{
+    const char *begin = text.data();
+    const char *end = begin + text.size();
+    const char *record = begin;
+    while (record < end)
+    {
+        if (*record == '\n' || *record == '\r')
+        {
+            ++record;
+            continue;
+        }
+        if (*record != '@')
+            exit(printf("Malformed FASTQ query after read %zu\n", m_next_id));
+
+        // Header, bases, separator and qualities, one line each
+        std::array<const char *, 5> lines{record};
+        for (size_t k = 1; k < lines.size(); ++k)
+        {
+            lines[k] = next_line(lines[k - 1], end);
+            if (lines[k] == nullptr)
+            {
+                if (!end_of_file)
+                    return static_cast<size_t>(record - begin);
+                if (k < lines.size() - 1)
+                    exit(printf("Truncated FASTQ query at the end of the file\n"));
+                lines[k] = end;
+            }
+        }
+        if (*lines[2] != '+')
+            exit(printf("Malformed FASTQ query after read %zu\n", m_next_id));
+
+        add_read(lines[1], line_size(lines[1], lines[2]));
+        if (m_stop)
+            return text.size();
+        record = lines[4];
+    }
+    return text.size();
+}
+
+void QueryReader::add_read(const char *seq, size_t size)
+{
+    m_batch.push_back(seq, size, m_next_id++);
+    if (m_batch.size() >= m_batch_size)
+        push_batch();
+}
+
+void QueryReader::push_batch()
+{
+    if (!m_batches.push(std::move(m_batch)))
+    {
+        m_stop = true;
+        return;
+    }
+    m_batch.clear();
+    if (m_free_batches.try_pop(m_batch))
+        m_batch.clear();
+    m_batch.reserve(m_batch_size);
+}
@@ -0,0 +1,76 @@
+#ifndef QUERY_READER_HPP
+#define QUERY_READER_HPP
+
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bounded_queue.hpp"
+#include "line_windows.hpp"
+#include "read_batch.hpp"
+
+constexpr size_t QUERY_WINDOW_SIZE = 1UL << 22; // Small windows so the first batch comes out quickly
+constexpr size_t QUERY_BATCH_SIZE = 1UL << 17;
+
+/* -------------------------------------------------------------------------- */
+/*                                 QueryReader                                */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Reads queries from a FASTA or FASTQ file (plain, gzip or BGZF) in a pipeline: one thread reads and
+/// decompresses the file into text blocks, another one parses them into batches of encoded reads.
+class QueryReader
+{
+public:
+    /// @param file_path path of the queries file, the format is detected from its first record
+    /// @param batch_size number of reads of each batch
+    explicit QueryReader(const std::string &file_path, size_t batch_size = QUERY_BATCH_SIZE);
+    ~QueryReader();
+    QueryReader(const QueryReader &) = delete;
+    QueryReader &operator=(const QueryReader &) = delete;
+
+    /// @brief Get the next batch of reads, their ids follow the order of the file
+    /// @param batch receives the reads, its previous storage is given back to the parser
+    /// @return false at the end of the file
+    bool next(ReadBatch &batch);
+
+private:
+    enum class Format
+    {
+        UNKNOWN,
+        FASTA,
+        FASTQ,
+    };
+
+    void read_text();
+    void parse_text();
+
+    /// @brief Parse the complete records at the beginning of the text
+    /// @return size of the parsed text, the rest must be parsed again with the next block
+    size_t parse_records(std::string_view text, bool end_of_file);
+    size_t parse_fasta(std::string_view text, bool end_of_file);
+    size_t parse_fastq(std::string_view text, bool end_of_file);
+    void add_read(const char *seq, size_t size);
+    void push_batch();
+
+    LineWindows m_windows;
+    size_t m_batch_size;
+    std::atomic<bool> m_stop{};
+
+    BoundedQueue<std::string> m_text_blocks{4};
+    BoundedQueue<std::string> m_free_text_blocks{8}; // More than blocks in flight, never waits
+    BoundedQueue<ReadBatch> m_batches{4};
+    BoundedQueue<ReadBatch> m_free_batches{8};
+
+    // Parser state
+    Format m_format{Format::UNKNOWN};
+    ReadBatch m_batch;
+    std::string m_bases; // Bases of a multi-line FASTA record
+    size_t m_next_id{};
+
+    std::thread m_reader_thread;
+    std::thread m_parser_thread;
+};
+
+#endif // QUERY_READER_HPP
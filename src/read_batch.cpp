@@ -0,0 +1,131 @@
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+
+#include "binary_io.hpp"
+#include "read_batch.hpp"
+#include "simd_kernels.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                              ReadBatch implem                              */
+/* -------------------------------------------------------------------------- */
+
+void ReadBatch::push_back(const char *seq, size_t nb_bases, uint64_t id)
+{
+    if (m_size == m_slots.size())
+        reserve(std::max<size_t>(1024, 2 * m_size));
+
+    // Whole slot is rewritten so a reused slot does not keep bases of the previous read
+    auto &slot = m_slots[m_size].codes;
+    slot.fill(0);
+    simd_kernels().encode_bases(seq, std::min<size_t>(nb_bases, MAX_QUERY_SIZE), slot.data());
+    m_sizes[m_size] = static_cast<uint32_t>(nb_bases);
+    m_ids[m_size] = id;
+    ++m_size;
+}
+
+void ReadBatch::push_back(const ReadView &read)
+{
+    if (m_size == m_slots.size())
+        reserve(std::max<size_t>(1024, 2 * m_size));
+
+    std::copy_n(read.codes, READ_SLOT_SIZE, m_slots[m_size].codes.data());
+    m_sizes[m_size] = static_cast<uint32_t>(read.nb_bases);
+    m_ids[m_size] = read.id;
+    ++m_size;
+}
+
+void ReadBatch::reserve(size_t nb_reads)
+{
+    if (nb_reads <= m_slots.size())
+        return;
+    m_slots.resize(nb_reads);
+    m_sizes.resize(nb_reads);
+    m_ids.resize(nb_reads);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              ReadSpool implem                              */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Bytes of codes stored for a read
+inline size_t spooled_size(uint32_t nb_bases)
+{
+    return (std::min<size_t>(nb_bases, MAX_QUERY_SIZE) + 3) / 4;
+}
+
+ReadSpool::ReadSpool(std::string file_path) : m_file_path(std::move(file_path)), m_out(m_file_path, std::ios::binary)
+{
+    if (!m_out)
+        exit(printf("Cannot create spool file %s\n", m_file_path.c_str()));
+}
+
+ReadSpool::~ReadSpool()
+{
+    m_out.close();
+    m_in.close();
+    std::filesystem::remove(m_file_path);
+}
+
+void ReadSpool::write(const ReadBatch &batch)
+{
+    // Batch header, then sizes, ids and codes as arrays
+    uint64_t nb_reads = batch.size();
+    m_sizes.resize(nb_reads);
+    m_ids.resize(nb_reads);
+    m_codes.clear();
+    for (size_t i = 0; i < nb_reads; ++i)
+    {
+        m_sizes[i] = batch.read_size(i);
+        m_ids[i] = batch.id(i);
+        m_codes.insert(m_codes.end(), batch.slot(i), batch.slot(i) + spooled_size(m_sizes[i]));
+    }
+    uint64_t nb_codes = m_codes.size();
+    write_binary(nb_reads, m_out);
+    write_binary(nb_codes, m_out);
+    write_binary(m_sizes, m_out);
+    write_binary(m_ids, m_out);
+    write_binary(m_codes, m_out);
+    if (!m_out)
+        exit(printf("Cannot write spool file %s\n", m_file_path.c_str()));
+}
+
+void ReadSpool::rewind()
+{
+    m_out.flush();
+    m_in.close();
+    m_in.open(m_file_path, std::ios::binary);
+    if (!m_in)
+        exit(printf("Cannot read spool file %s\n", m_file_path.c_str()));
+}
+
+bool ReadSpool::read(ReadBatch &batch)
+{
+    uint64_t nb_reads = 0, nb_codes = 0;
+    read_binary(nb_reads, m_in);
+    read_binary(nb_codes, m_in);
+    if (!m_in)
+        return false;
+    m_sizes.resize(nb_reads);
+    m_ids.resize(nb_reads);
+    m_codes.resize(nb_codes);
+    read_binary(m_sizes, m_in);
+    read_binary(m_ids, m_in);
+    read_binary(m_codes, m_in);
+    if (!m_in)
+        exit(printf("Spool file %s is truncated\n", m_file_path.c_str()));
+
+    batch.clear();
+    batch.reserve(nb_reads);
+    ReadSlot slot{};
+    const auto *codes = m_codes.data();
+    for (size_t i = 0; i < nb_reads; ++i)
+    {
+        auto size = spooled_size(m_sizes[i]);
+        slot.codes.fill(0);
+        std::copy_n(codes, size, slot.codes.data());
+        codes += size;
+        batch.push_back(ReadView{slot.codes.data(), m_sizes[i], m_ids[i]});
+    }
+    return true;
+}
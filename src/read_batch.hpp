@@ -0,0 +1,109 @@
+#ifndef READ_BATCH_HPP
+#define READ_BATCH_HPP
+
+#include <array>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "compact_sequence.hpp"
+#include "pim_common.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                                  ReadBatch                                 */
+/* -------------------------------------------------------------------------- */
+
+/// @brief 2-bit codes of one read, laid out like one query of MapArgs::queries
+constexpr size_t READ_SLOT_SIZE = MAX_QUERY_SIZE >> 2;
+
+struct alignas(64) ReadSlot
+{
+    std::array<uint8_t, READ_SLOT_SIZE> codes;
+};
+
+/// @brief Non-owning view on one read of a batch
+struct ReadView
+{
+    const uint8_t *codes;
+    size_t nb_bases;
+    uint64_t id;
+
+    uint8_t operator[](std::size_t idx) const { return (codes[idx >> 2] >> CompactSequence::SHIFT_PUSH[idx & 3]) & 3; }
+    size_t size() const { return nb_bases; }
+};
+
+/// @brief Reads stored as structure of arrays: one arena of fixed size slots, plus their sizes and ids.
+/// Storage is kept by clear(), so a batch reused for the next reads does not allocate anymore.
+class ReadBatch
+{
+public:
+    ReadBatch() = default;
+    ReadBatch(ReadBatch &&other) noexcept { *this = std::move(other); }
+    ReadBatch &operator=(ReadBatch &&other) noexcept
+    {
+        m_slots = std::move(other.m_slots);
+        m_sizes = std::move(other.m_sizes);
+        m_ids = std::move(other.m_ids);
+        m_size = std::exchange(other.m_size, 0);
+        return *this;
+    }
+
+    /// @brief Encode a read in the next slot
+    /// @param seq bases as characters
+    /// @param nb_bases size of the read, only its first MAX_QUERY_SIZE bases are encoded when it is longer
+    /// @param id identifier of the read
+    void push_back(const char *seq, size_t nb_bases, uint64_t id);
+    /// @brief Copy an encoded read in the next slot
+    void push_back(const ReadView &read);
+
+    void reserve(size_t nb_reads);
+    void clear() { m_size = 0; }
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    size_t capacity() const { return m_slots.size(); }
+
+    ReadView operator[](size_t i) const { return {m_slots[i].codes.data(), m_sizes[i], m_ids[i]}; }
+    const uint8_t *slot(size_t i) const { return m_slots[i].codes.data(); }
+    uint32_t read_size(size_t i) const { return m_sizes[i]; }
+    uint64_t id(size_t i) const { return m_ids[i]; }
+
+private:
+    std::vector<ReadSlot> m_slots;
+    std::vector<uint32_t> m_sizes;
+    std::vector<uint64_t> m_ids;
+    size_t m_size{};
+};
+
+/* -------------------------------------------------------------------------- */
+/*                                  ReadSpool                                 */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Temporary file holding encoded batches, to go through the reads again without parsing the queries file.
+/// Each read takes its size, its id and the bytes of its codes, not a whole slot.
+class ReadSpool
+{
+public:
+    /// @param file_path path of the spool file, removed with the spool
+    explicit ReadSpool(std::string file_path);
+    ~ReadSpool();
+    ReadSpool(const ReadSpool &) = delete;
+    ReadSpool &operator=(const ReadSpool &) = delete;
+
+    void write(const ReadBatch &batch);
+    /// @brief Read the batches again from the first one
+    void rewind();
+    /// @return false once all the batches are read
+    bool read(ReadBatch &batch);
+
+private:
+    std::string m_file_path;
+    std::ofstream m_out;
+    std::ifstream m_in;
+    std::vector<uint32_t> m_sizes;
+    std::vector<uint64_t> m_ids;
+    std::vector<uint8_t> m_codes;
+};
+
+#endif // READ_BATCH_HPP
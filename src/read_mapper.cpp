@@ -1,69 +1,256 @@
 #include <cmath>
 #include <omp.h>
 #include <algorithm>
+#include <limits>
 
 #include "read_mapper.hpp"
-#include "signature.hpp"
 
 ssize_t ceil_log2(ssize_t x)
 {
     return ceil(log(static_cast<double>(x)) / log(2));
 }
 
-std::vector<ssize_t> fill_bloom_filters(MultiBloomFilter &bloom_filters, const CompactReference &ref_read, ssize_t nb_dpu, ssize_t dpu_ref_size, ssize_t overlap)
+// Bloom filter build parameters
+constexpr ssize_t BUILD_SEGMENT_SIZE = 1 << 16;        // Reference positions hashed in one go
+constexpr ssize_t BUILD_SEGMENTS_PER_ROUND = 4;        // Per thread, bounds the scratch memory between two merges
+constexpr ssize_t BUILD_PARTITIONS_PER_THREAD = 16;    // More partitions than threads to balance the merge
+constexpr uint64_t BUILD_PARTITION_BLOCK2 = 12;        // Partitions interleave blocks of 4 K packs of the filter
+
+/// @brief Append the packed (place << 6 | bit) entries of the good signatures of one segment of a DPU slice
+/// @param contigs if not empty, only the signatures lying inside one contig are added
+template <typename BloomFilter>
+ssize_t add_segment_signatures(const BloomFilter &bloom_filters, const CompactReference &ref_read, ssize_t dpu_id,
+                               size_t start, size_t end, const ContigRanges &contigs, std::vector<uint64_t> &sigs)
 {
-    constexpr ssize_t build_nr_threads = 16;
-    std::vector<ssize_t> nb_signatures(build_nr_threads, 0);
+    ssize_t nb_signatures = 0;
+    std::array<uint8_t, 4> bases{};
+    bases[0] = ref_read.seq[start];
+    bases[1] = ref_read.seq[start + 1];
+    bases[2] = ref_read.seq[start + 2];
+    bases[3] = ref_read.seq[start + 3];
+    auto add = [&sigs](const std::pair<uint64_t, uint64_t> &place_mask)
+    { sigs.push_back((place_mask.first << bf_pack_size2) + static_cast<uint64_t>(__builtin_ctzll(place_mask.second))); };
 
-#pragma omp parallel for schedule(dynamic) num_threads(build_nr_threads)
-    for (ssize_t dpu_id = 0; dpu_id < nb_dpu; ++dpu_id)
+    MapperSignature signature(ref_read.seq, start);
+
+    // First contig not ending before start
+    auto contig = std::lower_bound(contigs.begin(), contigs.end(), start, [](const auto &range, size_t pos)
+                                   { return range.first + range.second <= pos; });
+
+    for (size_t i = start; i < end; ++i, signature.roll())
     {
-        auto tid = omp_get_thread_num();
-        auto start = dpu_id * (dpu_ref_size - overlap);
-        std::array<uint8_t, 4> bases{};
-        bases[0] = ref_read.seq[start];
-        bases[1] = ref_read.seq[start + 1];
-        bases[2] = ref_read.seq[start + 2];
-        bases[3] = ref_read.seq[start + 3];
-        std::vector<std::pair<uint32_t, uint64_t>> sigs;
-        sigs.reserve(dpu_ref_size);
-
-        for (size_t i = start; i < start + dpu_ref_size - HASH_SIZE; ++i)
+        while (contig != contigs.end() && contig->first + contig->second <= i)
+            ++contig;
+        bool in_contig = contigs.empty() || (contig != contigs.end() && i >= contig->first &&
+                                             i + HASH_SIZE <= contig->first + contig->second);
+        if (in_contig && is_good_seed(bases))
         {
-            if (is_good_seed(bases))
-                sigs.emplace_back(bloom_filters.place_mask(dpu_id, Signature<HASH_SIZE>::hash(ref_read, i)));
-
-            bases[0] = bases[1];
-            bases[1] = bases[2];
-            bases[2] = bases[3];
-            bases[3] = ref_read.seq[i + 4];
+            auto hash = signature.value();
+            if constexpr (requires { bloom_filters.place_masks(dpu_id, hash); })
+            {
+                for (const auto &place_mask : bloom_filters.place_masks(dpu_id, hash))
+                    add(place_mask);
+            }
+            else
+                add(bloom_filters.place_mask(dpu_id, hash));
+            ++nb_signatures;
         }
 
-        std::sort(sigs.begin(), sigs.end(), [](const auto &a, const auto &b)
-                  { return a.first < b.first; });
+        bases[0] = bases[1];
+        bases[1] = bases[2];
+        bases[2] = bases[3];
+        bases[3] = ref_read.seq[i + 4];
+    }
+    return nb_signatures;
+}
+
+/// @brief Fill the filters on all host cores without atomics: in each round, every thread hashes a few segments
+/// of the reference and buckets the entries by partition of the filter, then every partition is merged by the
+/// single thread owning it
+template <typename BloomFilter>
+std::vector<ssize_t> fill_bloom_filters(BloomFilter &bloom_filters, const CompactReference &ref_read, const ReferencePartition &slices,
+                                        const ContigRanges &contigs)
+{
+    const ssize_t nb_threads = omp_get_max_threads();
+    const ssize_t nb_partitions = nb_threads * BUILD_PARTITIONS_PER_THREAD;
+    const auto nb_dpu = slices.nb_dpu();
 
-        for (const auto &[place, mask] : sigs)
+    // Slices may differ in size: dpu_first_segment[d] is the first segment of DPU d
+    std::vector<ssize_t> dpu_first_segment(nb_dpu + 1, 0);
+    for (size_t dpu_id = 0; dpu_id < nb_dpu; ++dpu_id)
+    {
+        auto nb_positions = static_cast<ssize_t>(slices.size(dpu_id)) - static_cast<ssize_t>(HASH_SIZE);
+        dpu_first_segment[dpu_id + 1] = dpu_first_segment[dpu_id] + (nb_positions + BUILD_SEGMENT_SIZE - 1) / BUILD_SEGMENT_SIZE;
+    }
+    const ssize_t nb_segments = dpu_first_segment.back();
+    auto partition = [nb_partitions](uint64_t entry)
+    { return static_cast<ssize_t>((entry >> (bf_pack_size2 + BUILD_PARTITION_BLOCK2)) % nb_partitions); };
+
+    std::vector<ssize_t> nb_signatures(nb_threads, 0);
+    std::vector<std::vector<uint64_t>> buckets(nb_threads); // Entries of each thread, sorted by partition
+    std::vector<std::vector<size_t>> bucket_offsets(nb_threads, std::vector<size_t>(nb_partitions + 1));
+    auto &data = bloom_filters.data();
+
+#pragma omp parallel num_threads(nb_threads)
+    {
+        auto tid = omp_get_thread_num();
+        std::vector<uint64_t> sigs;
+        sigs.reserve(BUILD_SEGMENTS_PER_ROUND * BUILD_SEGMENT_SIZE);
+        auto &bucket = buckets[tid];
+        auto &offsets = bucket_offsets[tid];
+
+        for (ssize_t round_start = 0; round_start < nb_segments; round_start += nb_threads * BUILD_SEGMENTS_PER_ROUND)
         {
-            bloom_filters.insert_computed(place, mask); // Relevant signature
-            nb_signatures[tid]++;
+            // Hash the segments of this thread
+            sigs.clear();
+            auto first_segment = round_start + tid * BUILD_SEGMENTS_PER_ROUND;
+            auto last_segment = std::min(first_segment + BUILD_SEGMENTS_PER_ROUND, nb_segments);
+            for (auto segment = first_segment; segment < last_segment; ++segment)
+            {
+                auto dpu_id = static_cast<size_t>(std::upper_bound(dpu_first_segment.begin(), dpu_first_segment.end(), segment) -
+                                                  dpu_first_segment.begin() - 1);
+                auto dpu_start = static_cast<ssize_t>(slices.start_pos(dpu_id));
+                auto start = dpu_start + (segment - dpu_first_segment[dpu_id]) * BUILD_SEGMENT_SIZE;
+                auto end = std::min(start + BUILD_SEGMENT_SIZE,
+                                    dpu_start + static_cast<ssize_t>(slices.size(dpu_id)) - static_cast<ssize_t>(HASH_SIZE));
+                nb_signatures[tid] += add_segment_signatures(bloom_filters, ref_read, dpu_id, start, end, contigs, sigs);
+            }
+
+            // Counting sort by partition
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (auto entry : sigs)
+                offsets[partition(entry) + 1]++;
+            for (ssize_t p = 0; p < nb_partitions; ++p)
+                offsets[p + 1] += offsets[p];
+            bucket.resize(sigs.size());
+            std::vector<size_t> cursors(offsets.begin(), offsets.end() - 1);
+            for (auto entry : sigs)
+                bucket[cursors[partition(entry)]++] = entry;
+
+#pragma omp barrier
+
+            // Merge: each partition is only written by the thread owning it
+#pragma omp for schedule(dynamic)
+            for (ssize_t p = 0; p < nb_partitions; ++p)
+            {
+                for (ssize_t t = 0; t < nb_threads; ++t)
+                {
+                    for (auto k = bucket_offsets[t][p]; k < bucket_offsets[t][p + 1]; ++k)
+                    {
+                        auto entry = buckets[t][k];
+                        data[entry >> bf_pack_size2] |= 1UL << (entry & (bf_pack_size - 1));
+                    }
+                }
+            }
         }
     }
 
     return nb_signatures;
 }
 
-MultiBloomFilter build_bloom_filters(const CompactReference &ref_read, ssize_t nb_dpu, ssize_t dpu_ref_size, ssize_t overlap)
+MultiBloomFilter build_bloom_filters(const CompactReference &ref_read, const ReferencePartition &slices, const ContigRanges &contigs)
 {
-    auto bloom_size2 = ceil_log2(dpu_ref_size * 8);
+    // Rows are shared by all DPUs, sized for the largest slice
+    auto bloom_size2 = ceil_log2(static_cast<ssize_t>(slices.max_size()) * 8);
     MultiBloomFilter bloom_filters{};
-    bloom_filters.initialize(nb_dpu, bloom_size2);
-    auto nb_signatures = fill_bloom_filters(bloom_filters, ref_read, nb_dpu, dpu_ref_size, overlap);
+    bloom_filters.initialize(static_cast<ssize_t>(slices.nb_dpu()), bloom_size2);
+    auto nb_signatures = fill_bloom_filters(bloom_filters, ref_read, slices, contigs);
+    return bloom_filters;
+}
+
+std::vector<uint64_t> count_dpu_signatures(const CompactReference &ref_read, const ReferencePartition &slices, const ContigRanges &contigs)
+{
+    const auto nb_dpu = static_cast<ssize_t>(slices.nb_dpu());
+    std::vector<uint64_t> counts(slices.nb_dpu(), 0);
+
+    // Same positions as add_segment_signatures, without hashing
+#pragma omp parallel for schedule(dynamic)
+    for (ssize_t dpu_id = 0; dpu_id < nb_dpu; ++dpu_id)
+    {
+        auto start = slices.start_pos(dpu_id);
+        if (slices.size(dpu_id) <= HASH_SIZE)
+            continue;
+        auto end = start + slices.size(dpu_id) - HASH_SIZE;
+        auto contig = std::lower_bound(contigs.begin(), contigs.end(), start, [](const auto &range, size_t pos)
+                                       { return range.first + range.second <= pos; });
+        std::array<uint8_t, 4> bases{ref_read.seq[start], ref_read.seq[start + 1], ref_read.seq[start + 2], ref_read.seq[start + 3]};
+        uint64_t count = 0;
+        for (auto i = start; i < end; ++i)
+        {
+            while (contig != contigs.end() && contig->first + contig->second <= i)
+                ++contig;
+            bool in_contig = contigs.empty() || (contig != contigs.end() && i >= contig->first &&
+                                                 i + HASH_SIZE <= contig->first + contig->second);
+            count += (in_contig && is_good_seed(bases)) ? 1 : 0;
+            bases = {bases[1], bases[2], bases[3], ref_read.seq[i + 4]};
+        }
+        counts[dpu_id] = count;
+    }
+    return counts;
+}
+
+/// @brief Rows for which the bits of a DPU (or rank) holding nb_signatures are set in a share fill of the rows
+uint64_t rows_for_fill(uint64_t nb_signatures, double fill)
+{
+    return std::max<uint64_t>(1, static_cast<uint64_t>(std::ceil(static_cast<double>(nb_signatures) / -std::log1p(-fill))));
+}
+
+HierarchicalBloomFilter build_hierarchical_bloom_filters(const CompactReference &ref_read, const std::vector<uint32_t> &rank_start_dpu_id,
+                                                         const ReferencePartition &slices, const ContigRanges &contigs,
+                                                         double target_fpr)
+{
+    const auto nb_ranks = rank_start_dpu_id.size() - 1;
+    auto dpu_signatures = count_dpu_signatures(ref_read, slices, contigs);
+    uint64_t max_rank_signatures = 0;
+    std::vector<uint64_t> max_dpu_signatures(nb_ranks, 0); // Largest DPU of each rank, it sets the rows of the rank
+    for (size_t rank_id = 0; rank_id < nb_ranks; ++rank_id)
+    {
+        uint64_t rank_signatures = 0;
+        for (auto dpu_id = rank_start_dpu_id[rank_id]; dpu_id < rank_start_dpu_id[rank_id + 1]; ++dpu_id)
+        {
+            rank_signatures += dpu_signatures[dpu_id];
+            max_dpu_signatures[rank_id] = std::max(max_dpu_signatures[rank_id], dpu_signatures[dpu_id]);
+        }
+        max_rank_signatures = std::max(max_rank_signatures, rank_signatures);
+    }
+
+    // A lookup ANDs the rows of two signatures in each level: an absent DPU is matched with probability
+    // (rank_fill * dpu_fill)^2. The split of the fill between the levels is the one taking the least memory.
+    const double fill_product = std::sqrt(target_fpr);
+    const uint64_t rank_sub_size = (nb_ranks + bf_pack_size - 1) >> bf_pack_size2;
+    uint64_t best_size = std::numeric_limits<uint64_t>::max(), rank_nb_rows = 0;
+    std::vector<uint64_t> dpu_nb_rows;
+    for (double rank_fill = 0.99; rank_fill > fill_product; rank_fill -= 0.01)
+    {
+        auto rows = rows_for_fill(max_rank_signatures, rank_fill);
+        std::vector<uint64_t> rank_rows(nb_ranks);
+        uint64_t size = rows * rank_sub_size;
+        for (size_t rank_id = 0; rank_id < nb_ranks; ++rank_id)
+        {
+            rank_rows[rank_id] = rows_for_fill(max_dpu_signatures[rank_id], std::min(fill_product / rank_fill, 0.99));
+            size += rank_rows[rank_id];
+        }
+        bool fits = rows <= (1UL << 32) && std::all_of(rank_rows.begin(), rank_rows.end(), [](uint64_t r)
+                                                       { return r <= (1UL << 32); });
+        if (fits && size < best_size)
+        {
+            best_size = size;
+            rank_nb_rows = rows;
+            dpu_nb_rows = std::move(rank_rows);
+        }
+    }
+    if (dpu_nb_rows.empty())
+        exit(printf("Hierarchical bloom filter cannot reach a false positive rate of %g with 2^32 rows per level\n", target_fpr));
+
+    HierarchicalBloomFilter bloom_filters{};
+    bloom_filters.initialize(rank_start_dpu_id, rank_nb_rows, dpu_nb_rows);
+    fill_bloom_filters(bloom_filters, ref_read, slices, contigs);
     return bloom_filters;
 }
 
 void serialize_bloom_filters(const MultiBloomFilter &bloom_filters, const std::string &bloom_file_path)
 {
-    bloom_filters.save_to_file(bloom_file_path);
+    bloom_filters.save_to_file(bloom_file_path, MapperSignature::scheme());
 }
 
 ssize_t get_reference_size(CompactReference &reference)
@@ -1,16 +1,57 @@
 #ifndef READ_MAPPER_HPP
 #define READ_MAPPER_HPP
 
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <unordered_map>
+
 #include "read.hpp"
 #include "bloom_filter.hpp"
+#include "hierarchical_bloom_filter.hpp"
+#include "partition.hpp"
 #include "pim_common.hpp"
+#include "signature.hpp"
 
 #include "BS_thread_pool_light.hpp"
 
 constexpr size_t HASH_SIZE = 70;
 constexpr std::array<size_t, 2> ROUND_SHIFTS = {5, 15};
 
-MultiBloomFilter build_bloom_filters(const CompactReference &ref_read, ssize_t nb_dpu, ssize_t dpu_ref_size, ssize_t overlap);
+// Signatures used by both the bloom filters build and the queries dispatch
+using MapperSignature = RollingSignature<HASH_SIZE>;
+
+// False positive DPUs per lookup the hierarchical filter is sized for: about the one of the flat filter, whose 8 rows
+// per base hold the signatures of the good seeds only (~42% of the bases). Both levels are sized from the signatures
+// of their ranks and DPUs, with the split of the fill between the levels that takes the least memory.
+constexpr double HBF_TARGET_FPR = 0.0025;
+constexpr size_t FPR_NB_PROBES = 1UL << 16; // Random lookups measuring the false positive rate of a filter
+
+/// @brief Signatures inserted in the filters for each DPU
+/// @param contigs if not empty, the signatures crossing the junction of two contigs are not counted
+std::vector<uint64_t> count_dpu_signatures(const CompactReference &ref_read, const ReferencePartition &slices, const ContigRanges &contigs = {});
+
+/// @param contigs if not empty, the signatures crossing the junction of two contigs are left out of the filters
+MultiBloomFilter build_bloom_filters(const CompactReference &ref_read, const ReferencePartition &slices, const ContigRanges &contigs = {});
+/// @param target_fpr share of the DPUs matched by the lookup of a read absent from them
+HierarchicalBloomFilter build_hierarchical_bloom_filters(const CompactReference &ref_read, const std::vector<uint32_t> &rank_start_dpu_id,
+                                                         const ReferencePartition &slices, const ContigRanges &contigs = {},
+                                                         double target_fpr = HBF_TARGET_FPR);
+
+/// @brief Share of the DPUs matched by the lookup of random signatures, as for a read absent from the reference
+template <typename BloomFilter>
+double measure_false_positive_rate(const BloomFilter &bloom_filters, size_t nb_dpu)
+{
+    std::mt19937 gen(FPR_NB_PROBES);
+    std::vector<std::pair<hash_t, hash_t>> signatures(FPR_NB_PROBES);
+    for (auto &signature : signatures)
+        signature = {static_cast<hash_t>(gen()), static_cast<hash_t>(gen())};
+    BfBatchResult result;
+    bloom_filters.contains_batch(signatures, result);
+    return static_cast<double>(result.dpu_ids.size()) / static_cast<double>(FPR_NB_PROBES * std::max<size_t>(nb_dpu, 1));
+}
 
 struct Mapping
 {
@@ -67,10 +108,28 @@ private:
     std::array<size_t, MAX_NB_ERRORS + 1> stats{};
 };
 
+/// @brief Queries staged for a rank: the arguments of each of its DPUs, and the queries sent to several of them,
+/// broadcast once to the rank
+struct RankArgs : std::vector<MapAllArgs>
+{
+    SharedQueries shared{};
+    uint32_t nb_shared{};  // Slots of shared in use
+    uint64_t generation{}; // Incremented each time the buffer is acquired, the shared slots of older uses are stale
+
+    /// @brief Private query slots sent to every DPU, the ones of its fullest DPU
+    uint32_t max_private() const
+    {
+        uint32_t nb_private = 0;
+        for (const auto &arg : *this)
+            nb_private = std::max(nb_private, arg.nb_private);
+        return nb_private;
+    }
+};
+
 class MapAllArgsAllocator
 {
 public:
-    using type_t = std::vector<MapAllArgs>;
+    using type_t = RankArgs;
     MapAllArgsAllocator() {}
     MapAllArgsAllocator(const MapAllArgsAllocator &other) : buffers(other.buffers), available(other.available) {}
 
@@ -110,15 +169,250 @@ private:
     std::mutex mutex;
 };
 
+enum class LaunchTrigger
+{
+    FULL_DPU = 0,  // A DPU buffer (and its overflow area, if any) is full
+    RANK_FILL = 1, // The queries staged for the rank reached the fill threshold
+    MAX_AGE = 2,   // The oldest query staged for the rank is too old
+    FLUSH = 3,     // End of the queries
+};
+
+/// @brief Fill ratio of the launched ranks (queries sent / capacity of the rank), to tune the launch policy
+class LaunchStatistics
+{
+public:
+    void record(LaunchTrigger trigger, size_t nb_queries, size_t capacity)
+    {
+        auto fill = static_cast<double>(nb_queries) / static_cast<double>(capacity);
+        auto t = static_cast<size_t>(trigger);
+        ++nb_launches[t];
+        fill_sum[t] += fill;
+        ++fill_histogram[std::min(static_cast<size_t>(fill * 10.0), fill_histogram.size() - 1)];
+    }
+
+    /// @brief Query slots sent to a launched rank, and the ones sent with one slot per (query, DPU) pair
+    void record_transfer(size_t nb_slots, size_t nb_pair_slots)
+    {
+        slots_sent += nb_slots;
+        pair_slots += nb_pair_slots;
+    }
+
+    void print() const
+    {
+        static constexpr std::array<const char *, 4> TRIGGER_NAMES = {"full DPU", "rank fill", "max age", "flush"};
+        size_t total = 0;
+        double total_fill = 0.0;
+        for (size_t t = 0; t < nb_launches.size(); ++t)
+        {
+            total += nb_launches[t];
+            total_fill += fill_sum[t];
+        }
+        printf("Rank launches: %zu, mean fill %.1f%%\n", total, total > 0 ? total_fill * 100.0 / static_cast<double>(total) : 0.0);
+        for (size_t t = 0; t < nb_launches.size(); ++t)
+        {
+            if (nb_launches[t] > 0)
+                printf("  %-10s %10zu  mean fill %5.1f%%\n", TRIGGER_NAMES[t], nb_launches[t],
+                       fill_sum[t] * 100.0 / static_cast<double>(nb_launches[t]));
+        }
+        printf("Fill ratio histogram:");
+        for (size_t d = 0; d < fill_histogram.size(); ++d)
+            printf(" %zu-%zu%%: %zu%s", d * 10, d * 10 + 10, fill_histogram[d], d + 1 < fill_histogram.size() ? "," : "\n");
+        printf("Query transfers: %.1f MB, %.1f MB with one copy per (read, DPU) pair\n",
+               static_cast<double>(slots_sent * READ_SLOT_SIZE) / 1e6, static_cast<double>(pair_slots * READ_SLOT_SIZE) / 1e6);
+    }
+
+private:
+    std::array<size_t, 4> nb_launches{};
+    std::array<double, 4> fill_sum{};
+    std::array<size_t, 10> fill_histogram{}; // Per 10% of fill, the last one includes full ranks
+    size_t slots_sent{};
+    size_t pair_slots{};
+};
+
+/// @brief Time from the arrival of a read (its batch is handed to the dispatch) to the post-processing of its last
+/// mapping result. Reads routed to no DPU have no latency.
+class LatencyTracker
+{
+public:
+    using clock = std::chrono::steady_clock;
+
+    /// @brief Reads first_id to end_id (excluded) just arrived, must hold MappingWorkerData::mutex
+    void arrive(uint64_t first_id, uint64_t end_id)
+    {
+        batch_first_id.push_back(first_id);
+        batch_arrival_us.push_back(elapsed_us());
+        done_us.resize(end_id, -1);
+    }
+
+    /// @brief A result of the read was processed, must hold MappingWorkerData::mutex
+    void done(uint64_t id) { done_us[id] = elapsed_us(); }
+
+    void print() const
+    {
+        std::vector<int64_t> latencies;
+        latencies.reserve(done_us.size());
+        for (size_t b = 0; b < batch_first_id.size(); ++b)
+        {
+            auto end_id = b + 1 < batch_first_id.size() ? batch_first_id[b + 1] : done_us.size();
+            for (auto id = batch_first_id[b]; id < end_id; ++id)
+                if (done_us[id] >= 0)
+                    latencies.push_back(done_us[id] - batch_arrival_us[b]);
+        }
+        if (latencies.empty())
+            return;
+        auto percentile = [&latencies](double p)
+        {
+            auto nth = latencies.begin() + static_cast<ssize_t>(p * static_cast<double>(latencies.size() - 1));
+            std::nth_element(latencies.begin(), nth, latencies.end());
+            return static_cast<double>(*nth) / 1000.0;
+        };
+        auto p50 = percentile(0.5), p99 = percentile(0.99), max = percentile(1.0);
+        printf("Read latency (%zu reads): p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", latencies.size(), p50, p99, max);
+    }
+
+private:
+    int64_t elapsed_us() const { return std::chrono::duration_cast<std::chrono::microseconds>(clock::now() - start).count(); }
+
+    clock::time_point start{clock::now()};
+    std::vector<uint64_t> batch_first_id;
+    std::vector<int64_t> batch_arrival_us;
+    std::vector<int64_t> done_us; // Per read, -1 until a result is processed
+};
+
+/// @brief Staging state of one rank, besides its buffer in MappingWorkerData::rank_args
+struct RankStaging
+{
+    RankArgs *overflow{};                // Spilled queries of the DPUs whose buffer is full
+    size_t nb_queries{};                 // Queries staged in the main buffer
+    std::chrono::steady_clock::time_point oldest{}; // Time the first query of the main buffer was staged
+    double arrival_rate{};                          // Staged queries per ms, moving average over the launches
+};
+
+constexpr size_t DISPATCH_BLOCK_SIZE = 4096; // Reads routed together by the batched dispatch
+constexpr size_t SPECULATION_NB_PROBES = 4;  // Signatures of a read checked against each candidate DPU to rank them
+
+/// @brief Read kept on the host to be sent later to more DPUs: the other candidates of a speculative read, or the
+/// candidates of a read set aside by the repeat path
+struct PendingRead
+{
+    ReadSlot slot;
+    uint32_t nb_bases;
+    uint32_t start_pos;
+    std::vector<uint32_t> others; // Candidate DPUs it is still to be sent to
+};
+
+/// @brief Number of candidate DPUs of each read, with the (read, DPU) pairs they account for
+class FanoutStatistics
+{
+public:
+    void record(size_t nb_candidates, size_t nb_sent)
+    {
+        auto bucket = nb_candidates <= 4 ? nb_candidates : std::min<size_t>(std::bit_width(nb_candidates - 1) + 2, nb_reads.size() - 1);
+        ++nb_reads[bucket];
+        nb_pairs[bucket] += nb_sent;
+        nb_capped += nb_sent < nb_candidates;
+    }
+
+    void print() const
+    {
+        static constexpr std::array<const char *, 10> BUCKET_NAMES = {"0", "1", "2", "3", "4", "5-8", "9-16", "17-32", "33-64", ">64"};
+        size_t total_reads = 0, total_pairs = 0;
+        for (size_t b = 0; b < nb_reads.size(); ++b)
+        {
+            total_reads += nb_reads[b];
+            total_pairs += nb_pairs[b];
+        }
+        printf("Fan-out per read (candidate DPUs - reads - share of the (read, DPU) pairs), %zu reads capped:\n", nb_capped);
+        for (size_t b = 0; b < nb_reads.size(); ++b)
+        {
+            if (nb_reads[b] > 0)
+                printf("%6s  %12zu  %6.2f%%\n", BUCKET_NAMES[b], nb_reads[b],
+                       static_cast<double>(nb_pairs[b]) * 100.0 / static_cast<double>(std::max<size_t>(total_pairs, 1)));
+        }
+    }
+
+private:
+    std::array<size_t, 10> nb_reads{}; // Exact up to 4 candidates, then per power of 2
+    std::array<size_t, 10> nb_pairs{};
+    size_t nb_capped{};
+};
+
+/// @brief Reads of the speculative dispatch waiting for their first result, accessed under MappingWorkerData::mutex
+class SpeculationTable
+{
+public:
+    /// @brief First result of a speculative read: done if perfect, else it fans out to its other candidates. Results
+    /// of reads no longer pending (fanned out already, or duplicated) are ignored.
+    void resolve(uint64_t id, uint32_t distance)
+    {
+        auto it = pending.find(id);
+        if (it == pending.end())
+            return;
+        if (distance == 0)
+        {
+            nb_saved += it->second.others.size();
+            ++nb_perfect;
+            pending.erase(it);
+        }
+        else
+            failed.push_back(id);
+    }
+
+    void print() const
+    {
+        printf("Speculative dispatch: %zu reads with several candidates, %zu perfect on the first DPU, %zu fanned out, "
+               "%zu (read, DPU) pairs saved\n",
+               nb_speculative, nb_perfect, nb_fanned_out, nb_saved);
+    }
+
+    std::unordered_map<uint64_t, PendingRead> pending;
+    std::vector<uint64_t> failed; // Ids of the pending reads to send to their other candidates
+    size_t nb_speculative{};
+    size_t nb_perfect{};
+    size_t nb_fanned_out{};
+    size_t nb_saved{};
+};
+
+/// @brief Shared region slot of a query, valid while the buffer is not launched
+struct SharedSlot
+{
+    const RankArgs *buffer{};
+    uint64_t generation{};
+    uint32_t slot{};
+};
+
+/// @brief Buffers of the batched dispatch, reused from one block of reads to the next
+struct DispatchScratch
+{
+    std::vector<uint32_t> reads;     // Index in the batch of each routed query
+    std::vector<uint32_t> start_pos; // Seed position of each routed query
+    std::vector<std::pair<hash_t, hash_t>> signatures;
+    std::vector<uint8_t> speculative; // Routed query waits for its result before its other candidates
+    std::vector<uint32_t> dpu_ends;   // Counting sort of the (query, DPU) pairs by DPU
+    std::vector<uint32_t> sorted;     // Routed queries, grouped by DPU
+    std::vector<uint32_t> rank_hits;  // DPUs of the current rank each query is sent to
+    std::vector<SharedSlot> shared_slots; // Slot of each query in the shared region of the buffer of the current rank
+    BfBatchResult capped;             // Candidates of each query within the fan-out cap
+    BfBatchResult routes;             // DPUs each query is sent to, when not all its candidates
+    std::vector<std::pair<uint64_t, PendingRead>> new_pending;
+    ReadBatch retry_reads; // Pending reads sent to more DPUs
+    std::vector<uint32_t> dpu_loads;  // Staged queries per DPU, for the least loaded fan-out policy
+    std::vector<uint32_t> candidates; // Candidates of one query, sorted by load
+    size_t round_robin{};             // Next first candidate of the round-robin fan-out policy
+    std::vector<std::pair<uint64_t, PendingRead>> repeats; // Reads over the fan-out cap, sent by blocks of REPEAT_BUFFER_SIZE
+    size_t next_replica{};               // Replica of the next read, for the round-robin replica policy
+    std::vector<size_t> replica_loads;   // Staged queries per replica, for the least loaded replica policy
+};
+
 class MappingWorkerData
 {
 public:
     MappingWorkerData(std::vector<Mapping> &res, size_t nb_ranks, BS::thread_pool_light &thread_pool,
-                      std::vector<size_t> &pos)
-        : result(res), pool(thread_pool), positions(pos), rank_args(nb_ranks, NULL)
+                      std::vector<size_t> &pos, size_t buffers_per_rank = 2)
+        : result(res), pool(thread_pool), positions(pos), rank_args(nb_ranks, NULL), staging(nb_ranks)
     {
         nb_dispatches.fill(0);
-        allocator.initialize(nb_ranks * 2);
+        allocator.initialize(nb_ranks * buffers_per_rank);
     }
     MappingWorkerData(const MappingWorkerData &other)
         : allocator(other.allocator), result(other.result), pool(other.pool), positions(other.positions) {}
@@ -128,7 +422,16 @@ public:
     std::vector<Mapping> &result;
     BS::thread_pool_light &pool;
     const std::vector<size_t> &positions;
-    std::vector<std::vector<MapAllArgs> *> rank_args;
+    std::vector<RankArgs *> rank_args;
+    std::vector<RankStaging> staging;
+    LaunchStatistics launch_stats;
+    std::vector<uint64_t> dpu_hits;          // Queries sent to each DPU, saved as a load profile
+    std::unique_ptr<LatencyTracker> latency; // Only in latency mode
+    SpeculationTable speculation;
+    FanoutStatistics fanout_stats;
+    std::mutex staging_mutex;                // Staging is shared with the deadline timer in latency mode
+    BfBatchResult bf_result;
+    DispatchScratch dispatch;
     std::mutex mutex;
 };
 
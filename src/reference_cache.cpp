@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "binary_io.hpp"
+#include "reference_cache.hpp"
+#include "reference_loader.hpp"
+
+constexpr size_t CACHE_PAGE_SIZE = 4096;
+constexpr size_t CACHE_TAIL_SIZE = 1UL << 16; // Zeros after the bases, DPU slices are rounded up past the end
+constexpr size_t FINGERPRINT_HEAD_SIZE = 1UL << 20;
+
+ReferenceFingerprint compute_file_fingerprint(const std::string &reference_path)
+{
+    ReferenceFingerprint fingerprint{};
+    int fd = open(reference_path.c_str(), O_RDONLY);
+    struct stat st{};
+    if (fd < 0 || fstat(fd, &st) != 0)
+        exit(printf("Cannot open file: %s\n", reference_path.c_str()));
+    fingerprint.file_size = static_cast<uint64_t>(st.st_size);
+    fingerprint.mtime_ns = st.st_mtim.tv_sec * 1'000'000'000L + st.st_mtim.tv_nsec;
+
+    std::vector<uint8_t> head(std::min<size_t>(FINGERPRINT_HEAD_SIZE, fingerprint.file_size));
+    auto nb_read = pread(fd, head.data(), head.size(), 0);
+    close(fd);
+    if (nb_read != static_cast<ssize_t>(head.size()))
+        exit(printf("Cannot read file: %s\n", reference_path.c_str()));
+    fingerprint.head_crc = static_cast<uint32_t>(crc32(0, head.data(), static_cast<uInt>(head.size())));
+    return fingerprint;
+}
+
+ReferenceFingerprint compute_reference_fingerprint(const std::string &reference_path)
+{
+    auto fingerprint = compute_file_fingerprint(reference_path);
+    auto files = reference_files(reference_path);
+    if (files.size() == 1 && files[0] == reference_path)
+        return fingerprint;
+
+    // A change of any file of the album changes the fingerprint
+    for (const auto &file_path : files)
+    {
+        auto file = compute_file_fingerprint(file_path);
+        fingerprint.file_size += file.file_size;
+        fingerprint.mtime_ns = std::max(fingerprint.mtime_ns, file.mtime_ns);
+        fingerprint.head_crc = static_cast<uint32_t>(crc32(fingerprint.head_crc, reinterpret_cast<const Bytef *>(&file),
+                                                           static_cast<uInt>(sizeof(file))));
+    }
+    return fingerprint;
+}
+
+void save_reference_cache(const std::string &cache_path, const std::string &reference_path,
+                          const CompactReference &reference)
+{
+    ReferenceCacheHeader header{};
+    header.source = compute_reference_fingerprint(reference_path);
+    header.nb_bases = reference.seq.size();
+    header.nb_sequences = reference.names.size();
+    size_t table_size = 0;
+    for (const auto &name : reference.names)
+        table_size += 2 * sizeof(uint64_t) + sizeof(uint32_t) + name.name.size();
+    header.data_offset = (sizeof(header) + table_size + CACHE_PAGE_SIZE - 1) & ~(CACHE_PAGE_SIZE - 1);
+
+    auto tmp_path = cache_path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary);
+    write_binary(header, out);
+    for (const auto &name : reference.names)
+    {
+        write_binary(static_cast<uint64_t>(name.start_pos), out);
+        write_binary(static_cast<uint64_t>(name.size), out);
+        write_binary(static_cast<uint32_t>(name.name.size()), out);
+        write_binary(name.name, out);
+    }
+    std::vector<char> padding(header.data_offset - sizeof(header) - table_size, 0);
+    write_binary(padding, out);
+    out.write(reinterpret_cast<const char *>(reference.seq.data()), static_cast<std::streamsize>(reference.seq.data_size()));
+    padding.assign(CACHE_TAIL_SIZE, 0);
+    write_binary(padding, out);
+    out.close();
+    if (!out)
+        exit(printf("Cannot write reference cache %s\n", tmp_path.c_str()));
+    std::filesystem::rename(tmp_path, cache_path);
+}
+
+bool load_reference_cache(const std::string &cache_path, const std::string &reference_path, CompactReference &reference)
+{
+    if (!std::filesystem::exists(cache_path))
+        return false;
+
+    int fd = open(cache_path.c_str(), O_RDONLY);
+    struct stat st{};
+    if (fd < 0 || fstat(fd, &st) != 0)
+        exit(printf("Cannot open file: %s\n", cache_path.c_str()));
+    auto file_size = static_cast<size_t>(st.st_size);
+    if (file_size < sizeof(ReferenceCacheHeader))
+    {
+        close(fd);
+        printf("Reference cache %s is truncated, ignoring it\n", cache_path.c_str());
+        return false;
+    }
+    void *file = mmap(nullptr, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (file == MAP_FAILED)
+        exit(printf("Cannot mmap file: %s\n", cache_path.c_str()));
+    std::shared_ptr<uint8_t> mapping(static_cast<uint8_t *>(file), [file_size](uint8_t *p)
+                                     { munmap(p, file_size); });
+
+    ReferenceCacheHeader header{};
+    memcpy(&header, mapping.get(), sizeof(header));
+    if (header.magic != ReferenceCacheHeader::MAGIC ||
+        header.data_offset + (header.nb_bases + 3) / 4 > file_size)
+    {
+        printf("Reference cache %s has no valid header, ignoring it\n", cache_path.c_str());
+        return false;
+    }
+    if (header.source != compute_reference_fingerprint(reference_path))
+    {
+        printf("Reference cache %s was built from another version of %s, ignoring it\n", cache_path.c_str(),
+               reference_path.c_str());
+        return false;
+    }
+
+    // Sequence table
+    const uint8_t *table = mapping.get() + sizeof(header);
+    const uint8_t *table_end = mapping.get() + header.data_offset;
+    auto read_table = [&table, table_end](void *dst, size_t size)
+    {
+        if (table + size > table_end)
+            return false;
+        memcpy(dst, table, size);
+        table += size;
+        return true;
+    };
+    reference.names.resize(header.nb_sequences);
+    for (auto &name : reference.names)
+    {
+        uint64_t start_pos = 0, size = 0;
+        uint32_t name_size = 0;
+        if (!read_table(&start_pos, sizeof(start_pos)) || !read_table(&size, sizeof(size)) ||
+            !read_table(&name_size, sizeof(name_size)) || table + name_size > table_end)
+            exit(printf("Reference cache %s is corrupted, remove it\n", cache_path.c_str()));
+        name.name.assign(reinterpret_cast<const char *>(table), name_size);
+        table += name_size;
+        name.start_pos = start_pos;
+        name.size = size;
+    }
+
+    madvise(mapping.get() + header.data_offset, file_size - header.data_offset, MADV_WILLNEED);
+    reference.seq.map(std::shared_ptr<uint8_t>(mapping, mapping.get() + header.data_offset), header.nb_bases);
+    return true;
+}
@@ -0,0 +1,49 @@
+#ifndef REFERENCE_CACHE_HPP
+#define REFERENCE_CACHE_HPP
+
+#include <cstdint>
+#include <string>
+
+#include "read.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                               Reference cache                              */
+/* -------------------------------------------------------------------------- */
+
+// The index app saves the encoded reference (both strands and the sequence table) next to the FASTA file, the mapper
+// mmaps it instead of parsing the FASTA file again. The encoded bases are page aligned in the file so DPU transfers
+// read them straight from the mapping.
+
+/// @brief Identifies the FASTA file a cache was built from, or the album and all its files
+struct ReferenceFingerprint
+{
+    uint64_t file_size{};
+    int64_t mtime_ns{};
+    uint32_t head_crc{}; // CRC32 of the first MB
+    uint32_t unused{};   // Unused field, only there to align size on multiple of 8
+
+    bool operator==(const ReferenceFingerprint &) const = default;
+};
+
+struct ReferenceCacheHeader
+{
+    static constexpr uint64_t MAGIC = 0x3130'4645'5250'4d4d; // "MMPREF01"
+    uint64_t magic{MAGIC};
+    ReferenceFingerprint source{};
+    uint64_t nb_bases{};     // Both strands, as CompactSequence::size()
+    uint64_t nb_sequences{}; // Entries of the sequence table following the header
+    uint64_t data_offset{};  // Offset of the encoded bases, page aligned
+};
+
+/// @brief Fingerprint of a FASTA file, or of an album folded with the ones of its files
+ReferenceFingerprint compute_reference_fingerprint(const std::string &reference_path);
+
+/// @brief Save the encoded reference, through a temporary file renamed at the end
+void save_reference_cache(const std::string &cache_path, const std::string &reference_path,
+                          const CompactReference &reference);
+
+/// @brief Map a cached reference
+/// @return false if there is no cache or if it was built from another version of the reference
+bool load_reference_cache(const std::string &cache_path, const std::string &reference_path, CompactReference &reference);
+
+#endif // REFERENCE_CACHE_HPP
@@ -0,0 +1,245 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <omp.h>
+
+#include "file_utils.hpp"
+#include "line_windows.hpp"
+#include "reference_loader.hpp"
+#include "simd_kernels.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                              Reference loader                              */
+/* -------------------------------------------------------------------------- */
+
+constexpr size_t LOAD_CHUNK_SIZE = 1UL << 22; // Text bytes scanned and encoded by one task
+constexpr size_t LOAD_COPY_BLOCK = 1UL << 24; // Bytes copied by one task for the reverse complement strand
+
+/// @brief Bases of one sequence found in a chunk, between two header lines or the bounds of the chunk
+struct TextSegment
+{
+    const char *begin;
+    const char *end;
+    size_t nb_bases;
+    bool new_sequence;  // First segment of a sequence, right after its header
+    size_t start_pos{}; // Position of the first base in the reference
+};
+
+struct TextChunk
+{
+    const char *begin;
+    const char *end;
+    std::vector<TextSegment> segments;
+    std::vector<std::string> names; // Name of each new sequence of the chunk
+};
+
+/// @brief Calls func(line, length) for every line of [begin, end), without the line break
+template <typename F>
+void for_each_line(const char *begin, const char *end, F &&func)
+{
+    for (const char *line = begin; line < end;)
+    {
+        const auto *nl = static_cast<const char *>(memchr(line, '\n', static_cast<size_t>(end - line)));
+        const char *line_end = nl == nullptr ? end : nl;
+        auto length = static_cast<size_t>(line_end - line);
+        if (length > 0 && line[length - 1] == '\r')
+            --length;
+        func(line, length);
+        line = nl == nullptr ? end : nl + 1;
+    }
+}
+
+void scan_chunk(TextChunk &chunk)
+{
+    chunk.segments.clear();
+    chunk.names.clear();
+    TextSegment segment{chunk.begin, chunk.begin, 0, false};
+    for_each_line(chunk.begin, chunk.end, [&chunk, &segment](const char *line, size_t length)
+                  {
+        if (length > 0 && line[0] == '>')
+        {
+            segment.end = line;
+            if (segment.new_sequence || segment.nb_bases > 0)
+                chunk.segments.push_back(segment);
+            // Name is the first word of the header, as expected in SAM files
+            size_t name_size = 1;
+            while (name_size < length && line[name_size] != ' ' && line[name_size] != '\t')
+                ++name_size;
+            chunk.names.emplace_back(line + 1, name_size - 1);
+            segment = {line + length, line + length, 0, true};
+        }
+        else
+            segment.nb_bases += length; });
+    segment.end = chunk.end;
+    if (segment.new_sequence || segment.nb_bases > 0)
+        chunk.segments.push_back(segment);
+}
+
+/// @brief Encode the bases of a segment at its position, the sequence must be zeroed there
+void encode_segment(const TextSegment &segment, CompactSequence &seq, std::string &bases, std::vector<uint8_t> &codes)
+{
+    if (segment.nb_bases == 0)
+        return;
+
+    // Leading A's (code 0) align the segment on the byte holding its first base
+    bases.assign(segment.start_pos & 3, 'A');
+    for_each_line(segment.begin, segment.end, [&bases](const char *line, size_t length)
+                  { bases.append(line, length); });
+    codes.resize((bases.size() + 3) / 4);
+    simd_kernels().encode_bases(bases.data(), bases.size(), codes.data());
+
+    // Only the first and last bytes can be shared with the neighbouring segments
+    auto *out = seq.data(segment.start_pos);
+    __atomic_fetch_or(out, codes.front(), __ATOMIC_RELAXED);
+    if (codes.size() > 1)
+    {
+        memcpy(out + 1, codes.data() + 1, codes.size() - 2);
+        __atomic_fetch_or(out + codes.size() - 1, codes.back(), __ATOMIC_RELAXED);
+    }
+}
+
+/// @brief Split a window in chunks starting at the beginning of a line
+void split_window(std::string_view window, std::vector<TextChunk> &chunks)
+{
+    const auto nb_chunks = std::max<size_t>(1, (window.size() + LOAD_CHUNK_SIZE - 1) / LOAD_CHUNK_SIZE);
+    chunks.resize(nb_chunks);
+    const char *begin = window.data();
+    const char *end = window.data() + window.size();
+    for (size_t k = 0; k < nb_chunks; ++k)
+    {
+        chunks[k].begin = k == 0 ? begin : chunks[k - 1].end;
+        const char *chunk_end = begin + (k + 1) * window.size() / nb_chunks;
+        if (chunk_end < end && chunk_end > chunks[k].begin)
+        {
+            const auto *nl = static_cast<const char *>(memchr(chunk_end - 1, '\n', static_cast<size_t>(end - chunk_end + 1)));
+            chunk_end = nl == nullptr ? end : nl + 1;
+        }
+        chunks[k].end = std::max(chunk_end, chunks[k].begin);
+    }
+}
+
+std::vector<std::string> reference_files(const std::string &reference_path)
+{
+    std::ifstream in(reference_path, std::ios::binary);
+    if (!in)
+        exit(printf("Cannot open file: %s\n", reference_path.c_str()));
+    std::array<char, 2> magic{};
+    in.read(magic.data(), magic.size());
+    if (in.gcount() == 2 && static_cast<uint8_t>(magic[0]) == 0x1f && static_cast<uint8_t>(magic[1]) == 0x8b)
+        return {reference_path}; // gzip or BGZF FASTA
+    in.seekg(0);
+    char first = ' ';
+    while (in.get(first) && (first == ' ' || first == '\t' || first == '\r' || first == '\n'))
+        ;
+    if (!in || first == '>')
+        return {reference_path};
+
+    // Album: one FASTA file per line
+    in.seekg(0);
+    in.clear();
+    std::vector<std::string> files;
+    auto album_dir = std::filesystem::path(reference_path).parent_path();
+    for (std::string line; std::getline(in, line);)
+    {
+        auto first_char = line.find_first_not_of(" \t\r");
+        if (first_char == std::string::npos)
+            continue;
+        auto last_char = line.find_last_not_of(" \t\r");
+        std::filesystem::path path(line.substr(first_char, last_char - first_char + 1));
+        files.push_back((path.is_absolute() ? path : album_dir / path).string());
+    }
+    if (files.empty())
+        exit(printf("Reference %s is neither a FASTA file nor an album of FASTA files\n", reference_path.c_str()));
+    return files;
+}
+
+/// @brief Encode the forward strand of one FASTA file after the forward_size bases already in reference
+void load_fasta_file(const std::string &file_path, ssize_t nb_ranks, CompactReference &reference, size_t &forward_size,
+                     std::vector<TextChunk> &chunks)
+{
+    LineWindows windows(file_path);
+    if (windows.estimated_size() > 0)
+    {
+        check_reference_size(static_cast<ssize_t>(forward_size + windows.estimated_size()), nb_ranks);
+        reference.seq.reserve((forward_size + windows.estimated_size()) / 2 + 1); // Both strands, 4 bases per byte
+    }
+
+    bool in_sequence = false; // A header of this file was found
+    for (auto window = windows.next(); !window.empty(); window = windows.next())
+    {
+        split_window(window, chunks);
+        const auto nb_chunks = static_cast<ssize_t>(chunks.size());
+
+#pragma omp parallel for schedule(dynamic)
+        for (ssize_t k = 0; k < nb_chunks; ++k)
+            scan_chunk(chunks[k]);
+
+        // Sequences start on a byte, as with CompactSequence::append
+        for (auto &chunk : chunks)
+        {
+            size_t name_id = 0;
+            for (auto &segment : chunk.segments)
+            {
+                if (segment.new_sequence)
+                {
+                    forward_size = (forward_size + 3) & ~3UL;
+                    reference.names.push_back({std::move(chunk.names[name_id++]), forward_size, 0});
+                    in_sequence = true;
+                }
+                else if (!in_sequence)
+                    exit(printf("Reference %s does not start with a FASTA header\n", file_path.c_str()));
+                segment.start_pos = forward_size;
+                forward_size += segment.nb_bases;
+                reference.names.back().size += segment.nb_bases;
+            }
+        }
+        reference.seq.resize_bases(forward_size);
+
+#pragma omp parallel
+        {
+            std::string bases;
+            std::vector<uint8_t> codes;
+#pragma omp for schedule(dynamic)
+            for (ssize_t k = 0; k < nb_chunks; ++k)
+                for (const auto &segment : chunks[k].segments)
+                    encode_segment(segment, reference.seq, bases, codes);
+        }
+    }
+}
+
+CompactReference load_reference_parallel(const std::string &reference_path, ssize_t nb_ranks)
+{
+    CompactReference reference{};
+    std::vector<TextChunk> chunks;
+    size_t forward_size = 0;
+    for (const auto &file_path : reference_files(reference_path))
+        load_fasta_file(file_path, nb_ranks, reference, forward_size, chunks);
+
+    if (reference.names.empty())
+        exit(printf("Reference %s does not contain any sequence\n", reference_path.c_str()));
+    check_reference_size(static_cast<ssize_t>(forward_size), nb_ranks);
+
+    // Reverse complement strand: copy of the forward one, then every sequence is reverse complemented in place
+    const auto forward_bytes = reference.seq.data_size();
+    reference.seq.resize_bases(((forward_size + 3) & ~3UL) + forward_size);
+    auto *data = reference.seq.data();
+    const auto nb_copy_blocks = static_cast<ssize_t>((forward_bytes + LOAD_COPY_BLOCK - 1) / LOAD_COPY_BLOCK);
+#pragma omp parallel for
+    for (ssize_t b = 0; b < nb_copy_blocks; ++b)
+    {
+        auto offset = static_cast<size_t>(b) * LOAD_COPY_BLOCK;
+        memcpy(data + forward_bytes + offset, data + offset, std::min(LOAD_COPY_BLOCK, forward_bytes - offset));
+    }
+    const auto nb_sequences = static_cast<ssize_t>(reference.names.size());
+#pragma omp parallel for schedule(dynamic)
+    for (ssize_t i = 0; i < nb_sequences; ++i)
+    {
+        const auto &name = reference.names[i];
+        if (name.size > 0)
+            simd_kernels().revcomp_codes(data + forward_bytes + (name.start_pos >> 2), name.size);
+    }
+
+    return reference;
+}
@@ -0,0 +1,24 @@
+#ifndef REFERENCE_LOADER_HPP
+#define REFERENCE_LOADER_HPP
+
+#include <string>
+#include <vector>
+
+#include "read.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                              Reference loader                              */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Load a FASTA reference (plain, gzip or BGZF) and encode it with its reverse complement.
+/// Windows are split in line-aligned chunks, every chunk counts its bases, then all chunks are encoded in parallel
+/// at their precomputed offsets of the final sequence. The layout is the one of CompactSequence::append: every
+/// sequence starts on a byte, and the reverse complements follow the forward strand in the same order.
+/// @param reference_path FASTA file, or album listing FASTA files loaded one after the other
+CompactReference load_reference_parallel(const std::string &reference_path, ssize_t nb_ranks);
+
+/// @brief FASTA files of a reference: the file itself, or the files listed by an album (a text file with one path
+/// per line, relative to the directory of the album), in order. Files starting with '>' or gzip data are FASTA files.
+std::vector<std::string> reference_files(const std::string &reference_path);
+
+#endif // REFERENCE_LOADER_HPP
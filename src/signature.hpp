@@ -1,7 +1,20 @@
+#ifndef SIGNATURE_HPP
+#define SIGNATURE_HPP
+
+#include <array>
 #include <cstdint>
 
 #include "bloom_filter.hpp"
 #include "read.hpp"
+#include "read_batch.hpp"
+
+/// @brief Identifies how signatures are computed, stored in bloom filter files
+enum SignatureScheme : uint32_t
+{
+    SIGNATURE_DJB2 = 0,    // Signature: djb2 recomputed from scratch at each position
+    SIGNATURE_NTHASH = 1,  // RollingSignature before the split rotation, no longer built
+    SIGNATURE_NTHASH2 = 2, // RollingSignature: ntHash2-like split rotation, updated in constant time per position
+};
 
 template <size_t HashSize>
 class Signature
@@ -44,7 +57,95 @@ public:
     }
 
     static constexpr size_t hash_size() { return HashSize; }
+    static constexpr SignatureScheme scheme() { return SIGNATURE_DJB2; }
 
 private:
     static constexpr hash_t HASH_INIT_VALUE = 5381;
-};
\ No newline at end of file
+};
+
+/// @brief Rolling signature over 2-bit codes: XOR of rotated per-base seeds (ntHash), so moving the window
+/// by one base only removes the outgoing base and adds the incoming one. As in ntHash2, the 33 upper and 31 lower bits
+/// rotate separately: rotations repeat every 1023 bases instead of 64, so equal bases 64 apart in a window longer than
+/// 64 do not cancel out.
+template <size_t HashSize>
+class RollingSignature
+{
+public:
+    RollingSignature(const CompactSequence &seq, const size_t start_pos)
+        : m_seq(seq), m_pos(start_pos), m_val(compute(seq, start_pos)) {}
+
+    /// @brief Signature of the window starting at the current position
+    hash_t value() const { return finalize(m_val); }
+    size_t position() const { return m_pos; }
+
+    /// @brief Move the window one base forward
+    void roll()
+    {
+        m_val = split_rotl(m_val, 1) ^ OUT_SEEDS[m_seq[m_pos]] ^ SEEDS[m_seq[m_pos + HashSize]];
+        ++m_pos;
+    }
+
+    static hash_t hash(const Read &read, const size_t start_pos) { return finalize(compute(read.seq, start_pos)); }
+
+    static hash_t hash(const CompactReference &read, const size_t start_pos)
+    {
+        return finalize(compute(read.seq, start_pos));
+    }
+
+    static std::pair<hash_t, hash_t> hash(const Read &read, const size_t start_pos, const size_t start_pos2)
+    {
+        return std::make_pair(hash(read, start_pos), hash(read, start_pos2));
+    }
+
+    static std::pair<hash_t, hash_t> hash(const ReadView &read, const size_t start_pos, const size_t start_pos2)
+    {
+        return std::make_pair(finalize(compute(read, start_pos)), finalize(compute(read, start_pos2)));
+    }
+
+    static constexpr size_t hash_size() { return HashSize; }
+    static constexpr SignatureScheme scheme() { return SIGNATURE_NTHASH2; }
+
+private:
+    const CompactSequence &m_seq;
+    size_t m_pos;
+    uint64_t m_val;
+
+    // ntHash seeds, indexed by 2-bit code (A, C, T, G)
+    static constexpr std::array<uint64_t, 4> SEEDS = {0x3c8bfbb395c60474UL, 0x3193c18562a02b4cUL,
+                                                      0x295549f54be24456UL, 0x20323ed082572324UL};
+
+    static constexpr uint32_t LOW_BITS = 31; // The upper 33 bits rotate on their own
+    static constexpr uint64_t LOW_MASK = (1UL << LOW_BITS) - 1;
+
+    /// @brief Rotate the upper 33 bits and the lower 31 bits separately by n
+    static constexpr uint64_t split_rotl(uint64_t val, size_t n)
+    {
+        constexpr uint32_t high_bits = 64 - LOW_BITS;
+        constexpr uint64_t high_mask = (1UL << high_bits) - 1;
+        uint64_t high = val >> LOW_BITS, low = val & LOW_MASK;
+        auto high_n = static_cast<uint32_t>(n % high_bits), low_n = static_cast<uint32_t>(n % LOW_BITS);
+        high = ((high << high_n) | (high >> ((high_bits - high_n) % high_bits))) & high_mask;
+        low = ((low << low_n) | (low >> ((LOW_BITS - low_n) % LOW_BITS))) & LOW_MASK;
+        return (high << LOW_BITS) | low;
+    }
+
+    // Seeds of the base leaving the window, rotated by HashSize
+    static constexpr std::array<uint64_t, 4> OUT_SEEDS = {split_rotl(SEEDS[0], HashSize), split_rotl(SEEDS[1], HashSize),
+                                                          split_rotl(SEEDS[2], HashSize), split_rotl(SEEDS[3], HashSize)};
+
+    template <typename Sequence>
+    static uint64_t compute(const Sequence &seq, const size_t start_pos)
+    {
+        uint64_t val = 0;
+        for (size_t i = start_pos; i < HashSize + start_pos; ++i)
+        {
+            val = split_rotl(val, 1) ^ SEEDS[seq[i]];
+        }
+        return val;
+    }
+
+    // Filters use the lower bits of the signature, mix them with the whole 64 bits value
+    static hash_t finalize(uint64_t val) { return static_cast<hash_t>((val * 0x9E3779B97F4A7C15UL) >> 32); }
+};
+
+#endif // SIGNATURE_HPP
\ No newline at end of file
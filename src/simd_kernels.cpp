@@ -0,0 +1,262 @@
+#include <algorithm>
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <string_view>
+
+#include "bloom_filter.hpp"
+#include "simd_kernels.hpp"
+
+/* -------------------------------------------------------------------------- */
+/*                              Portable kernels                              */
+/* -------------------------------------------------------------------------- */
+
+/// @brief Encode 4 bases into one byte: keep bits 1-2 of each character, then gather the 4 fields in the upper
+/// byte with one multiplication (fields never overlap so there is no carry). No pext, which is microcoded on
+/// some AMD hosts.
+inline uint8_t encode_4bases(const char *c)
+{
+    uint32_t x = 0;
+    memcpy(&x, c, sizeof(x));
+    x = (x >> 1) & 0x0303'0303;
+    return static_cast<uint8_t>((x * 0x4010'0401U) >> 24);
+}
+
+void encode_bases_tail(const char *seq, size_t nb_bases, uint8_t *out)
+{
+    size_t i = 0;
+    for (; i + 4 <= nb_bases; i += 4)
+        *out++ = encode_4bases(seq + i);
+    if (i < nb_bases)
+    {
+        char last[4] = {0, 0, 0, 0}; // Pad with code 0
+        memcpy(last, seq + i, nb_bases - i);
+        *out = encode_4bases(last);
+    }
+}
+
+void encode_bases_portable(const char *seq, size_t nb_bases, uint8_t *out)
+{
+    encode_bases_tail(seq, nb_bases, out);
+}
+
+/// @brief Reverse the 4 2-bit codes of a byte and complement them (A <-> T is 0 <-> 2, C <-> G is 1 <-> 3)
+consteval std::array<uint8_t, 256> make_revcomp_byte_table()
+{
+    std::array<uint8_t, 256> table{};
+    for (size_t b = 0; b < 256; ++b)
+    {
+        table[b] = static_cast<uint8_t>((((b & 3) << 6) | (((b >> 2) & 3) << 4) | (((b >> 4) & 3) << 2) | (b >> 6)) ^ 0xAA);
+    }
+    return table;
+}
+
+constexpr auto REVCOMP_BYTE = make_revcomp_byte_table();
+
+void revcomp_bytes_portable(uint8_t *first, uint8_t *last)
+{
+    std::reverse(first, last);
+    for (; first != last; ++first)
+        *first = REVCOMP_BYTE[*first];
+}
+
+/// @brief After reversing, the padding of the last byte is at the start: shift everything to the left
+void remove_revcomp_padding(uint8_t *codes, size_t nb_bases)
+{
+    auto n = (nb_bases + 3) / 4;
+    auto shift = 2 * ((4 - (nb_bases & 3)) & 3);
+    if (shift == 0 || n == 0)
+        return;
+    for (size_t i = 0; i + 1 < n; ++i)
+        codes[i] = static_cast<uint8_t>((codes[i] << shift) | (codes[i + 1] >> (8 - shift)));
+    codes[n - 1] = static_cast<uint8_t>(codes[n - 1] << shift);
+}
+
+void revcomp_codes_portable(uint8_t *codes, size_t nb_bases)
+{
+    revcomp_bytes_portable(codes, codes + (nb_bases + 3) / 4);
+    remove_revcomp_padding(codes, nb_bases);
+}
+
+void and_rows_decode_portable(const uint64_t *row1, const uint64_t *row2, ssize_t sub_size, std::vector<uint32_t> &out)
+{
+    for (ssize_t i = 0; i < sub_size; ++i)
+        decode_pack(row1[i] & row2[i], static_cast<uint32_t>(i << bf_pack_size2), out);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                AVX2 kernels                                */
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx2,bmi"))) void encode_bases_avx2(const char *seq, size_t nb_bases, uint8_t *out)
+{
+    const auto mask = _mm256_set1_epi8(3);
+    const auto weights16 = _mm256_set1_epi16(0x0104);       // b0 * 4 + b1
+    const auto weights32 = _mm256_set1_epi32(0x0001'0010);  // (b0 b1) * 16 + (b2 b3)
+    const auto gather = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                         0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const auto lanes = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+    size_t i = 0;
+    for (; i + 32 <= nb_bases; i += 32, out += 8)
+    {
+        auto x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(seq + i));
+        x = _mm256_and_si256(_mm256_srli_epi16(x, 1), mask);
+        x = _mm256_madd_epi16(_mm256_maddubs_epi16(x, weights16), weights32);
+        x = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, gather), lanes);
+        _mm_storel_epi64(reinterpret_cast<__m128i *>(out), _mm256_castsi256_si128(x));
+    }
+    encode_bases_tail(seq + i, nb_bases - i, out);
+}
+
+/// @brief Lower nibble (codes 3 and 4 of a byte) to reversed and complemented upper nibble, for both 128 bits lanes
+consteval std::array<uint8_t, 32> make_revcomp_nibble_table()
+{
+    std::array<uint8_t, 32> table{};
+    for (size_t x = 0; x < 16; ++x)
+    {
+        table[x] = table[x + 16] = static_cast<uint8_t>(((((x & 3) << 2) | (x >> 2)) << 4) ^ 0xA0);
+    }
+    return table;
+}
+
+alignas(32) constexpr auto REVCOMP_NIBBLE = make_revcomp_nibble_table();
+
+/// @brief Reverse the 32 bytes of a register, then the codes inside each byte with two nibble lookups, and
+/// complement them
+__attribute__((target("avx2,bmi"))) inline __m256i revcomp_block_avx2(__m256i v)
+{
+    const auto reverse = _mm256_setr_epi8(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0,
+                                          15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0);
+    const auto lo_to_hi = _mm256_load_si256(reinterpret_cast<const __m256i *>(REVCOMP_NIBBLE.data()));
+    const auto hi_to_lo = _mm256_srli_epi16(lo_to_hi, 4);
+    const auto nibble = _mm256_set1_epi8(0x0F);
+    v = _mm256_shuffle_epi8(v, reverse);
+    v = _mm256_permute2x128_si256(v, v, 0x01); // Swap lanes
+    auto lo = _mm256_and_si256(v, nibble);
+    auto hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), nibble);
+    return _mm256_or_si256(_mm256_shuffle_epi8(lo_to_hi, lo), _mm256_and_si256(_mm256_shuffle_epi8(hi_to_lo, hi), nibble));
+}
+
+__attribute__((target("avx2,bmi"))) void revcomp_codes_avx2(uint8_t *codes, size_t nb_bases)
+{
+    // Swap and convert blocks from both ends, the middle is done with the portable code
+    size_t lo = 0, hi = (nb_bases + 3) / 4;
+    for (; hi - lo >= 64; lo += 32, hi -= 32)
+    {
+        auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(codes + lo));
+        auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(codes + hi - 32));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(codes + lo), revcomp_block_avx2(b));
+        _mm256_storeu_si256(reinterpret_cast<__m256i *>(codes + hi - 32), revcomp_block_avx2(a));
+    }
+    revcomp_bytes_portable(codes + lo, codes + hi);
+    remove_revcomp_padding(codes, nb_bases);
+}
+
+__attribute__((target("avx2,bmi"))) void and_rows_decode_avx2(const uint64_t *row1, const uint64_t *row2,
+                                                              ssize_t sub_size, std::vector<uint32_t> &out)
+{
+    ssize_t i = 0;
+    for (; i + 4 <= sub_size; i += 4)
+    {
+        auto v = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i *>(row1 + i)),
+                                  _mm256_loadu_si256(reinterpret_cast<const __m256i *>(row2 + i)));
+        if (_mm256_testz_si256(v, v))
+            continue; // Most common case, nothing in these 256 filters
+        alignas(32) uint64_t tmp[4];
+        _mm256_store_si256(reinterpret_cast<__m256i *>(tmp), v);
+        for (ssize_t j = 0; j < 4; ++j)
+            decode_pack(tmp[j], static_cast<uint32_t>((i + j) << bf_pack_size2), out);
+    }
+    for (; i < sub_size; ++i)
+        decode_pack(row1[i] & row2[i], static_cast<uint32_t>(i << bf_pack_size2), out);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               AVX-512 kernels                              */
+/* -------------------------------------------------------------------------- */
+
+__attribute__((target("avx512f,avx512bw,bmi"))) void encode_bases_avx512(const char *seq, size_t nb_bases,
+                                                                         uint8_t *out)
+{
+    const auto mask = _mm512_set1_epi8(3);
+    const auto weights16 = _mm512_set1_epi16(0x0104);
+    const auto weights32 = _mm512_set1_epi32(0x0001'0010);
+    size_t i = 0;
+    for (; i + 64 <= nb_bases; i += 64, out += 16)
+    {
+        auto x = _mm512_loadu_si512(seq + i);
+        x = _mm512_and_si512(_mm512_srli_epi16(x, 1), mask);
+        x = _mm512_madd_epi16(_mm512_maddubs_epi16(x, weights16), weights32);
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(out), _mm512_maskz_cvtepi32_epi8(0xFFFF, x)); // maskz: no GCC 12 warning
+    }
+    encode_bases_tail(seq + i, nb_bases - i, out);
+}
+
+__attribute__((target("avx512f,avx512bw,bmi"))) void and_rows_decode_avx512(const uint64_t *row1, const uint64_t *row2,
+                                                                            ssize_t sub_size, std::vector<uint32_t> &out)
+{
+    ssize_t i = 0;
+    for (; i + 8 <= sub_size; i += 8)
+    {
+        auto v = _mm512_and_si512(_mm512_loadu_si512(row1 + i), _mm512_loadu_si512(row2 + i));
+        auto nz = _mm512_test_epi64_mask(v, v);
+        if (nz == 0)
+            continue; // Most common case, nothing in these 512 filters
+        alignas(64) uint64_t tmp[8];
+        _mm512_store_si512(tmp, v);
+        for (; nz != 0; nz &= nz - 1)
+        {
+            auto j = __builtin_ctz(nz);
+            decode_pack(tmp[j], static_cast<uint32_t>((i + j) << bf_pack_size2), out);
+        }
+    }
+    for (; i < sub_size; ++i)
+        decode_pack(row1[i] & row2[i], static_cast<uint32_t>(i << bf_pack_size2), out);
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                  Selection                                 */
+/* -------------------------------------------------------------------------- */
+
+constexpr SimdKernels KERNELS[] = {
+    {SimdLevel::PORTABLE, "portable", encode_bases_portable, revcomp_codes_portable, and_rows_decode_portable},
+    {SimdLevel::AVX2, "AVX2", encode_bases_avx2, revcomp_codes_avx2, and_rows_decode_avx2},
+    {SimdLevel::AVX512, "AVX-512", encode_bases_avx512, revcomp_codes_avx2, and_rows_decode_avx512}, // Revcomp is bound by memory
+};
+
+SimdLevel detect_simd_level()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("bmi"))
+        return SimdLevel::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("bmi"))
+        return SimdLevel::AVX2;
+    return SimdLevel::PORTABLE;
+}
+
+SimdLevel requested_simd_level()
+{
+    const char *env = getenv("META_MAPPER_SIMD");
+    if (env == NULL)
+        return SimdLevel::AVX512;
+    std::string_view value(env);
+    if (value == "portable")
+        return SimdLevel::PORTABLE;
+    if (value == "avx2")
+        return SimdLevel::AVX2;
+    return SimdLevel::AVX512;
+}
+
+const SimdKernels &simd_kernels(SimdLevel level)
+{
+    static const auto supported = detect_simd_level();
+    return KERNELS[static_cast<int>(std::min(level, supported))];
+}
+
+const SimdKernels &simd_kernels()
+{
+    static const auto &kernels = simd_kernels(requested_simd_level());
+    return kernels;
+}
@@ -0,0 +1,50 @@
+#ifndef SIMD_KERNELS_HPP
+#define SIMD_KERNELS_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <sys/types.h>
+#include <vector>
+
+/* -------------------------------------------------------------------------- */
+/*                          Runtime dispatched kernels                        */
+/* -------------------------------------------------------------------------- */
+
+// Hot kernels have portable, AVX2 and AVX-512 implementations compiled with per-function target attributes.
+// The best one supported by the host is selected once from cpuid, so the same binary runs on all hosts.
+// Set META_MAPPER_SIMD=portable|avx2|avx512 in the environment to force a lower level.
+
+enum class SimdLevel
+{
+    PORTABLE = 0,
+    AVX2 = 1,   // AVX2 + BMI
+    AVX512 = 2, // AVX-512 F + BW + BMI
+};
+
+struct SimdKernels
+{
+    SimdLevel level;
+    const char *name;
+
+    /// @brief Encode bases with 2 bits per base, 4 bases per byte, first base in the upper bits
+    /// @param seq bases as characters
+    /// @param nb_bases number of bases to encode, the last byte is padded with 0s
+    /// @param out destination, must hold (nb_bases + 3) / 4 bytes
+    void (*encode_bases)(const char *seq, size_t nb_bases, uint8_t *out);
+
+    /// @brief Turn the 2-bit codes of a sequence into the codes of its reverse complement, in place
+    /// @param codes codes as written by encode_bases (last byte padded with 0s)
+    /// @param nb_bases number of bases of the sequence
+    void (*revcomp_codes)(uint8_t *codes, size_t nb_bases);
+
+    /// @brief AND two rows of packs and append the DPU ids of the bits set in both, in increasing order
+    void (*and_rows_decode)(const uint64_t *row1, const uint64_t *row2, ssize_t sub_size, std::vector<uint32_t> &out);
+};
+
+/// @brief Kernels of the best level supported by the host
+const SimdKernels &simd_kernels();
+
+/// @brief Kernels of a given level, or of the best supported level below it
+const SimdKernels &simd_kernels(SimdLevel level);
+
+#endif // SIMD_KERNELS_HPP
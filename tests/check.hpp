@@ -0,0 +1,19 @@
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <cstdio>
+#include <cstdlib>
+
+/* -------------------------------------------------------------------------- */
+/*                                 Host checks                                */
+/* -------------------------------------------------------------------------- */
+
+// Each check is a program run by `make check`, it exits with a non-zero status on the first failed condition
+
+#define CHECK(condition)                                                                  \
+    if (!(condition))                                                                     \
+    {                                                                                     \
+        exit(printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition));        \
+    }
+
+#endif // CHECK_HPP
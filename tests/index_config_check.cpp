@@ -0,0 +1,43 @@
+#include <cstdio>
+
+#include "check.hpp"
+#include "dpu_mapper_helper.hpp"
+
+/// @brief Configuration of DPU_INDEX_CONFIGS with this table and seed size
+size_t find_config(uint32_t index_size2, uint32_t seed_size)
+{
+    for (size_t config = 0; config < NB_DPU_INDEX_CONFIGS; ++config)
+        if (DPU_INDEX_CONFIGS[config].index_size2 == index_size2 && DPU_INDEX_CONFIGS[config].seed_size == seed_size)
+            return config;
+    exit(printf("No configuration %u:%u\n", index_size2, seed_size));
+}
+
+int main()
+{
+    const auto small = find_config(20, 10), medium = find_config(22, 11), large = find_config(23, 12);
+    find_config(22, 13); // Folded seeds are only picked when asked
+
+    // Smallest table with at most one position per cell
+    CHECK(pick_index_config(0) == small);
+    CHECK(pick_index_config(1UL << 20) == small);
+    CHECK(pick_index_config((1UL << 20) + 1) == medium);
+    CHECK(pick_index_config(1UL << 22) == medium);
+
+    // Then the largest table whose position table still holds the seeds
+    CHECK(pick_index_config((1UL << 22) + 1) == large);
+    CHECK(pick_index_config(INDEX_POS_CAPACITY(23)) == large);
+    CHECK(pick_index_config(INDEX_POS_CAPACITY(23) + 1) == medium);
+    CHECK(pick_index_config(INDEX_POS_CAPACITY(22)) == medium);
+    CHECK(pick_index_config(INDEX_POS_CAPACITY(22) + 1) == small);
+    CHECK(pick_index_config(INDEX_POS_CAPACITY(20)) == small);
+    CHECK(pick_index_config(INDEX_POS_CAPACITY(20) + 1) == AUTO_INDEX_CONFIG);
+
+    // Configurations are named as the dpu/Makefile builds
+    for (size_t config = 0; config < NB_DPU_INDEX_CONFIGS; ++config)
+        CHECK(parse_index_config(index_config_name(config)) == config);
+    CHECK(parse_index_config("auto") == AUTO_INDEX_CONFIG);
+    CHECK(dpu_binary_path(medium).ends_with("short_read_mapping_22_11"));
+
+    printf("index_config_check: OK\n");
+    return 0;
+}
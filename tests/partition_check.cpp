@@ -0,0 +1,101 @@
+#include <algorithm>
+#include <cstdio>
+#include <random>
+
+#include "check.hpp"
+#include "partition.hpp"
+#include "pim_common.hpp"
+
+constexpr size_t OVERLAP = 400; // As the mapper
+
+/// @brief Contigs of both strands laid out as contig_ranges does, each one starting on a byte
+ContigRanges make_contigs(std::mt19937 &rng, size_t nb_contigs, uint64_t max_size, uint64_t &reference_size)
+{
+    std::uniform_int_distribution<uint64_t> contig_size(1, max_size);
+    ContigRanges forward;
+    uint64_t end = 0;
+    for (size_t i = 0; i < nb_contigs; ++i)
+    {
+        auto start = CEILN<4>(end);
+        forward.emplace_back(start, contig_size(rng));
+        end = start + forward.back().second;
+    }
+    auto reverse_start = CEILN<4>(end);
+    ContigRanges contigs = forward;
+    for (const auto &[start, size] : forward)
+        contigs.emplace_back(reverse_start + start, size);
+    reference_size = reverse_start + end;
+    return contigs;
+}
+
+/// @brief Slices are aligned, cover the reference without gap, and a read of up to OVERLAP bases inside one contig
+/// lies in one slice
+void check_coverage(const ReferencePartition &partition, size_t reference_size, const ContigRanges &contigs)
+{
+    CHECK(partition.start_pos(0) == 0);
+    CHECK(partition.start_pos(partition.nb_dpu() - 1) + partition.size(partition.nb_dpu() - 1) >= reference_size);
+    for (size_t i = 0; i < partition.nb_dpu(); ++i)
+    {
+        CHECK(partition.start_pos(i) % 4 == 0 && partition.size(i) % 4 == 0);
+        CHECK(partition.size(i) <= MAX_DPU_REFERENCE_SIZE);
+        if (i + 1 == partition.nb_dpu())
+            continue;
+        auto end = partition.start_pos(i) + partition.size(i);
+        auto next = partition.start_pos(i + 1);
+        CHECK(partition.start_pos(i) < next && next <= end);
+
+        // A slice starting inside a contig leaves the first OVERLAP bases of the cut to the previous one
+        auto contig = std::upper_bound(contigs.begin(), contigs.end(), next, [](uint64_t pos, const auto &range)
+                                       { return pos < range.first; });
+        if (contig == contigs.begin())
+            continue;
+        --contig;
+        auto contig_end = contig->first + contig->second;
+        if (next > contig->first && next < contig_end)
+            CHECK(end >= std::min<uint64_t>(next + OVERLAP, contig_end));
+    }
+}
+
+/// @brief Passes map the consecutive subsets of the partition
+void check_subsets(const ReferencePartition &partition, size_t nb_passes)
+{
+    auto nb_slices = partition.nb_dpu() / nb_passes;
+    for (size_t pass = 0; pass < nb_passes; ++pass)
+    {
+        auto subset = partition.subset(pass * nb_slices, nb_slices);
+        CHECK(subset.nb_dpu() == nb_slices);
+        for (size_t i = 0; i < nb_slices; ++i)
+        {
+            CHECK(subset.start_pos(i) == partition.start_pos(pass * nb_slices + i));
+            CHECK(subset.size(i) == partition.size(pass * nb_slices + i));
+        }
+    }
+}
+
+int main()
+{
+    std::mt19937 rng(7);
+    struct Case
+    {
+        size_t nb_contigs;
+        uint64_t max_contig_size;
+        size_t nb_dpu;
+    };
+    // Many small contigs, contigs split over several slices, and more DPUs than contigs
+    for (auto [nb_contigs, max_contig_size, nb_dpu] : {Case{2000, 5000, 64}, Case{10, 2'000'000, 64}, Case{3, 100'000, 128},
+                                                       Case{1, 1'000'000, 16}, Case{500, 50'000, 256}})
+    {
+        uint64_t reference_size = 0;
+        auto contigs = make_contigs(rng, nb_contigs, max_contig_size, reference_size);
+        auto partition = ReferencePartition::contig_packed(reference_size, nb_dpu, OVERLAP, contigs);
+        CHECK(partition.nb_dpu() == nb_dpu);
+        check_coverage(partition, reference_size, contigs);
+        check_subsets(partition, 4);
+
+        auto uniform = ReferencePartition::uniform(reference_size, nb_dpu, OVERLAP);
+        check_coverage(uniform, reference_size, {{0, reference_size}});
+    }
+
+    printf("partition_check: OK\n");
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <cstdint>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+#include "check.hpp"
+#include "partition.hpp"
+#include "pim_common.hpp"
+#include "../dpu/dpu_utils.hpp"
+
+// Position table of the DPU program, as a plain array
+uint64_t pos_table[POS_TABLE_WORDS + 2];
+
+#include "../dpu/pos_packing.hpp"
+
+/// @brief Write positions from index first, then read them back with one cursor as the DPU does for a key
+void check_round_trip(uint32_t first, const std::vector<uint32_t> &positions)
+{
+    for (uint32_t i = 0; i < positions.size(); ++i)
+        write_pos(first + i, positions[i]);
+    PosCursor cursor;
+    cursor.init(first);
+    CHECK(cursor.value() == positions[0]);
+    for (uint32_t i = 1; i < positions.size(); ++i)
+        CHECK(cursor.next() == positions[i]);
+}
+
+int main()
+{
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<uint32_t> any_pos(0, static_cast<uint32_t>(POS_MASK));
+
+    // Every shift in a word, with positions using all the POS_BITS bits, then written again with other values
+    std::vector<uint32_t> positions(256);
+    for (auto &pos : positions)
+        pos = any_pos(rng);
+    positions[0] = static_cast<uint32_t>(POS_MASK);
+    positions[1] = 0;
+    check_round_trip(0, positions);
+    for (auto &pos : positions)
+        pos = static_cast<uint32_t>(POS_MASK) - pos;
+    check_round_trip(0, positions);
+
+    // Neighbours of a rewritten position are kept
+    write_pos(7, 12345);
+    PosCursor cursor;
+    cursor.init(6);
+    CHECK(cursor.value() == positions[6]);
+    CHECK(cursor.next() == 12345);
+    CHECK(cursor.next() == positions[8]);
+
+    // Last positions of the table, in the last words
+    for (auto &pos : positions)
+        pos = any_pos(rng);
+    check_round_trip(INDEX_POS_SIZE - static_cast<uint32_t>(positions.size()), positions);
+
+    // Largest position of a slice
+    CHECK(MAX_DPU_REFERENCE_SIZE - 1 <= POS_MASK);
+    write_pos(1000, static_cast<uint32_t>(MAX_DPU_REFERENCE_SIZE - 1));
+    cursor.init(1000);
+    CHECK(cursor.value() == MAX_DPU_REFERENCE_SIZE - 1);
+
+    printf("pos_packing_check: OK\n");
+    return 0;
+}
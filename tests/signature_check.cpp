@@ -0,0 +1,44 @@
+#include <cstdio>
+#include <random>
+#include <string>
+
+#include "check.hpp"
+#include "signature.hpp"
+
+constexpr size_t HASH_SIZE = 70; // As the mapper, longer than a 64 bits rotation
+
+using Rolling = RollingSignature<HASH_SIZE>;
+
+int main()
+{
+    std::mt19937 rng(11);
+    std::string bases;
+    for (size_t i = 0; i < 4 * HASH_SIZE; ++i)
+        bases += "ACGT"[rng() % 4];
+    Read read(bases, 0);
+
+    // Rolling the window gives the signature computed from scratch
+    Rolling signature(read.seq, 0);
+    for (size_t pos = 0; pos + HASH_SIZE < bases.size(); ++pos, signature.roll())
+        CHECK(signature.value() == Rolling::hash(read, pos));
+
+    // The same change at bases i and i + 64 does not cancel out
+    const auto codes = std::string("ACGT");
+    for (size_t i = 0; i + 64 < HASH_SIZE; ++i)
+    {
+        auto window = bases.substr(0, HASH_SIZE);
+        window[i + 64] = window[i];
+        auto reference_hash = Rolling::hash(Read(window, 0), 0);
+        for (auto base : codes)
+        {
+            if (base == window[i])
+                continue;
+            auto changed = window;
+            changed[i] = changed[i + 64] = base;
+            CHECK(Rolling::hash(Read(changed, 0), 0) != reference_hash);
+        }
+    }
+
+    printf("signature_check: OK\n");
+    return 0;
+}